@@ -0,0 +1,158 @@
+#include "compact.hpp"
+
+// rewrite one shard in key order without postings of deleted songs, in the
+// given bucket layout or, if bucket_bits is negative, the shard's own
+int compact_shard(const std::string &path,
+                  const std::set<std::array<unsigned char, 16>> &tombstones,
+                  int bucket_bits) {
+  std::string temp_path = path + ".compact";
+  std::remove(temp_path.c_str());
+
+  size_t postings_before = 0;
+  size_t postings_after = 0;
+  {
+    database src(path);
+
+    // read every list, dropping dead postings
+    std::vector<std::pair<uint32_t, std::vector<fp_data_t>>> lists;
+    src.scan_fp(
+        [&](uint32_t key, const std::vector<fp_data_t> &value) {
+          postings_before += value.size();
+          std::vector<fp_data_t> live;
+          for (const auto &p : value) {
+            std::array<unsigned char, 16> id;
+            std::copy(p.id, p.id + 16, id.begin());
+            if (tombstones.find(id) == tombstones.end()) {
+              live.push_back(p);
+            }
+          }
+          if (!live.empty()) {
+            lists.emplace_back(key, std::move(live));
+          }
+        },
+        false);
+
+    std::sort(lists.begin(), lists.end(),
+              [](const std::pair<uint32_t, std::vector<fp_data_t>> &a,
+                 const std::pair<uint32_t, std::vector<fp_data_t>> &b) {
+                return a.first < b.first;
+              });
+
+    // write the new shard, keeping the stop list and posting cap
+    database dst(temp_path);
+    if (src.get_max_postings() > 0) {
+      dst.set_max_postings(src.get_max_postings());
+    }
+    dst.set_bucket_bits(bucket_bits < 0 ? src.get_bucket_bits()
+                                        : static_cast<size_t>(bucket_bits));
+    for (uint32_t key : src.get_stop_keys()) {
+      dst.add_stop_key(key);
+    }
+    dst.append_fp_lists(lists);
+    for (const auto &l : lists) {
+      if (!dst.is_stop_key(l.first)) {
+        postings_after += l.second.size();
+      }
+    }
+  }
+
+  size_t size_before = file_size(path);
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    std::cerr << "Error: could not replace " << path << std::endl;
+    return 1;
+  }
+
+  std::cerr << path << ": " << postings_before << " -> " << postings_after
+            << " postings, " << size_before << " -> " << file_size(path)
+            << " bytes" << std::endl;
+  return 0;
+}
+
+// segments of dir still holding songs of tombstones, none if dir has no
+// segmented index
+std::vector<std::string>
+dirty_segments(const std::string &dir,
+               const std::set<std::array<unsigned char, 16>> &tombstones) {
+  std::vector<std::string> dirty;
+  segment_manifest manifest;
+  if (!manifest.read(dir)) {
+    return dirty;
+  }
+  for (const auto &name : manifest.segments) {
+    mmap_store segment;
+    if (!segment.open(segment_manifest::segment_path(dir, name)) ||
+        segment.holds_any_song(tombstones)) {
+      dirty.push_back(name);
+    }
+  }
+  return dirty;
+}
+
+void print_usage(const char *name) {
+  std::cout << "Usage: " << name << " [-b bucket_bits] [-S segment_dir]"
+            << std::endl;
+  std::cout << "Drop postings of deleted songs and rewrite the index"
+            << std::endl;
+  std::cout << "Tombstones are only cleared once no segment holds deleted "
+               "songs either, run mask_merge -a first"
+            << std::endl;
+  std::cout << "  -b  store lists in records of keys sharing all but their "
+               "low bucket_bits bits, 0 for one record per key"
+            << std::endl;
+  std::cout << "  -S  segmented index to check, default segments"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  // parse options
+  int bucket_bits = -1;
+  std::string segment_dir = "segments";
+  int opt;
+  while ((opt = getopt(argc, argv, "b:S:")) != -1) {
+    switch (opt) {
+    case 'b':
+      bucket_bits = std::stoi(optarg);
+      break;
+    case 'S':
+      segment_dir = optarg;
+      break;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind != argc ||
+      bucket_bits > static_cast<int>(database::MAX_BUCKET_BITS)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  size_t num_shards = sharded_database::count_shards("fingerprints.db");
+  if (num_shards == 0) {
+    std::cerr << "Error: no fingerprints.db" << std::endl;
+    return 1;
+  }
+
+  database song_db("songs.db");
+  auto tombstones = song_db.get_tombstones();
+
+  int ret = 0;
+  for (size_t i = 0; i < num_shards; ++i) {
+    ret |= compact_shard(
+        sharded_database::shard_path("fingerprints.db", i, num_shards),
+        tombstones, bucket_bits);
+  }
+
+  // deleted songs may be ingested again once every shard and segment is
+  // clean, until then the tombstones keep their postings out of results
+  auto dirty = dirty_segments(segment_dir, tombstones);
+  if (!dirty.empty()) {
+    std::cerr << "Keeping tombstones, " << dirty.size() << " segments in "
+              << segment_dir << " still hold deleted songs, run mask_merge -a "
+              << segment_dir << " first" << std::endl;
+  } else if (ret == 0) {
+    song_db.clear_tombstones();
+  }
+
+  return ret;
+}
@@ -0,0 +1,20 @@
+#ifndef _COMPACT_H
+#define _COMPACT_H
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "database.hpp"
+#include "mmap_store.hpp"
+#include "segment_manifest.hpp"
+#include "sharded_database.hpp"
+#include "types.hpp"
+
+#endif
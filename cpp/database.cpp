@@ -1,19 +1,97 @@
 #include "database.hpp"
 
-database::database(const std::string filename) {
-  rc = unqlite_open(&pDb, filename.c_str(), UNQLITE_OPEN_CREATE);
+// metadata records, keyed by strings that cannot collide with the 4 byte
+// fingerprint keys or the 16 byte song ids
+static const std::string STOP_KEYS_KEY = "stop_keys";
+static const std::string MAX_POSTINGS_KEY = "max_postings";
+static const std::string TOMBSTONES_KEY = "tombstones";
+static const std::string BUCKET_BITS_KEY = "bucket_bits";
+static const std::string STATS_KEY = "stats";
+
+// bucket records are keyed by 'b' and the bucket number, 5 bytes that
+// cannot collide with any other record either
+static const int BUCKET_KEY_LEN = 5;
+
+static void bucket_record_key(uint32_t bucket, unsigned char *rkey) {
+  rkey[0] = 'b';
+  std::memcpy(rkey + 1, &bucket, sizeof(bucket));
+}
+
+// forward index records of a song are keyed by 'f' and its id, holding
+// the number of blocks, and by 'f', the id and a block number, holding the
+// fingerprints of FORWARD_BLOCK time steps in time order
+static const int FORWARD_KEY_LEN = 17;
+static const int FORWARD_BLOCK_KEY_LEN = 21;
+
+static void forward_record_key(const std::array<unsigned char, 16> &id,
+                               uint32_t block, unsigned char *rkey) {
+  rkey[0] = 'f';
+  std::memcpy(rkey + 1, id.data(), 16);
+  std::memcpy(rkey + FORWARD_KEY_LEN, &block, sizeof(block));
+}
+
+database::database(const std::string filename, size_t cache_bytes,
+                   bool read_only)
+    : max_postings(0), bucket_bits(0), delta(), stats_dirty(false) {
+  rc = unqlite_open(&pDb, filename.c_str(),
+                    read_only ? UNQLITE_OPEN_READONLY : UNQLITE_OPEN_CREATE);
+  if (cache_bytes > 0) {
+    cache.reset(new posting_cache(cache_bytes));
+  }
+  load_stop_keys();
+  load_tombstones();
+
+  // a new file starts counting from zero, an older one without a stats
+  // record stays uncounted until recount_stats()
+  catalogue_stats stats;
+  empty_at_open = !read_stats(stats) && is_empty();
 }
 
 database::~database() {
-  unqlite_lib_shutdown();
+  // the counters go into the same write transaction as the records they
+  // count, which unqlite commits on close
+  if (stats_dirty) {
+    save_stats();
+  }
+
+  // close only this handle, other databases may still be open
+  unqlite_close(pDb);
 }
 
 std::vector<fp_data_t> database::get_fp(uint32_t key) {
+  // stop keys carry no information, skip them without any I/O
+  if (is_stop_key(key)) {
+    return std::vector<fp_data_t>();
+  }
+
+  if (!cache) {
+    return fetch_fp(key);
+  }
+
+  // serve repeated probes from the cache, including keys with no postings
   std::vector<fp_data_t> ret;
+  if (cache->get(key, ret)) {
+    return ret;
+  }
+  ret = fetch_fp(key);
+  cache->put(key, ret);
+  return ret;
+}
 
-  // get size of return value
+std::vector<fp_data_t> database::fetch_fp(uint32_t key) {
+  std::vector<fp_data_t> ret;
+
+  if (bucket_bits > 0) {
+    std::vector<uint8_t> raw;
+    if (!read_bucket(bucket_of(key), raw) || !find_in_bucket(raw, key, ret)) {
+      ret.clear();
+    }
+    return ret;
+  }
+
+  // get size of return value, rc is local so concurrent reads do not race
   unqlite_int64 nBytes;
-  rc = unqlite_kv_fetch(pDb, (void *)&key, sizeof(key), NULL, &nBytes);
+  int rc = unqlite_kv_fetch(pDb, (void *)&key, sizeof(key), NULL, &nBytes);
 
   // return length 0 vector if key is not found
   if (rc != UNQLITE_OK || nBytes == 0) {
@@ -22,24 +100,355 @@ std::vector<fp_data_t> database::get_fp(uint32_t key) {
   }
 
   // write value to a vector if a key is found
-  size_t vec_length = nBytes / sizeof(fp_data_t);
-  ret.resize(vec_length);
-  rc = unqlite_kv_fetch(pDb, static_cast<void *>(&key), sizeof(key), ret.data(),
-                        &nBytes);
+  ret.resize(nBytes / sizeof(fp_data_t));
+  unqlite_kv_fetch(pDb, static_cast<void *>(&key), sizeof(key), ret.data(),
+                   &nBytes);
 
   return ret;
 }
 
 void database::put_fp(uint32_t key, const fp_data_t &value) {
+  // postings for stop keys are dropped
+  if (is_stop_key(key)) {
+    return;
+  }
+
+  // a bucket is rewritten as a whole anyway
+  if (bucket_bits > 0) {
+    append_fp_lists({{key, {value}}});
+    return;
+  }
+
   // get current values
-  auto v = get_fp(key);
+  auto v = fetch_fp(key);
 
   // append new value
   v.push_back(value);
 
   // put value back into database
-  rc = unqlite_kv_store(pDb, static_cast<void *>(&key), sizeof(key), v.data(),
-                        v.size() * sizeof(fp_data_t));
+  store_list(key, v);
+}
+
+// store a whole posting list at once, honouring the stop list and cap
+void database::put_fp_list(uint32_t key, const std::vector<fp_data_t> &value) {
+  if (is_stop_key(key) || value.empty()) {
+    return;
+  }
+
+  if (bucket_bits == 0) {
+    store_list(key, value);
+    return;
+  }
+
+  std::vector<uint8_t> raw;
+  std::map<uint32_t, std::vector<fp_data_t>> lists;
+  uint32_t bucket = bucket_of(key);
+  if (read_bucket(bucket, raw)) {
+    decode_bucket(raw, lists);
+  }
+  if (over_cap(value.data(), value.size(), max_postings)) {
+    lists.erase(key);
+    add_stop_key(key);
+  } else {
+    lists[key] = value;
+  }
+  write_bucket(bucket, raw, lists);
+
+  if (cache) {
+    cache->erase(key);
+  }
+}
+
+// append lists to the ones already stored. in bucket mode every run of
+// lists falling into one bucket costs a single read and write, so lists
+// should come in key order
+void database::append_fp_lists(
+    const std::vector<std::pair<uint32_t, std::vector<fp_data_t>>> &lists) {
+  if (bucket_bits == 0) {
+    for (const auto &l : lists) {
+      if (is_stop_key(l.first) || l.second.empty()) {
+        continue;
+      }
+      auto v = fetch_fp(l.first);
+      v.insert(v.end(), l.second.begin(), l.second.end());
+      store_list(l.first, v);
+    }
+    return;
+  }
+
+  std::vector<uint8_t> raw;
+  std::map<uint32_t, std::vector<fp_data_t>> bucket_lists;
+  for (size_t i = 0; i < lists.size();) {
+    uint32_t bucket = bucket_of(lists[i].first);
+    bucket_lists.clear();
+    if (read_bucket(bucket, raw)) {
+      decode_bucket(raw, bucket_lists);
+    }
+
+    for (; i < lists.size() && bucket_of(lists[i].first) == bucket; ++i) {
+      uint32_t key = lists[i].first;
+      if (is_stop_key(key) || lists[i].second.empty()) {
+        continue;
+      }
+      auto &v = bucket_lists[key];
+      v.insert(v.end(), lists[i].second.begin(), lists[i].second.end());
+      if (over_cap(v.data(), v.size(), max_postings)) {
+        bucket_lists.erase(key);
+        add_stop_key(key);
+      }
+      if (cache) {
+        cache->erase(key);
+      }
+    }
+
+    write_bucket(bucket, raw, bucket_lists);
+  }
+}
+
+// look up several keys at once, calling fn with the index of each key. in
+// bucket mode the keys are visited bucket by bucket, so neighbouring keys
+// sharing a bucket cost one read
+void database::get_fp_batch(
+    const uint32_t *keys, size_t n,
+    const std::function<void(size_t, const std::vector<fp_data_t> &)> &fn) {
+  if (bucket_bits == 0) {
+    for (size_t i = 0; i < n; ++i) {
+      fn(i, get_fp(keys[i]));
+    }
+    return;
+  }
+
+  std::vector<size_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return bucket_of(keys[a]) < bucket_of(keys[b]);
+  });
+
+  std::vector<uint8_t> raw;
+  std::vector<fp_data_t> list;
+  bool loaded = false;
+  uint32_t current = 0;
+  for (size_t i : order) {
+    uint32_t key = keys[i];
+    if (is_stop_key(key)) {
+      list.clear();
+      fn(i, list);
+      continue;
+    }
+    if (cache && cache->get(key, list)) {
+      fn(i, list);
+      continue;
+    }
+
+    uint32_t bucket = bucket_of(key);
+    if (!loaded || bucket != current) {
+      read_bucket(bucket, raw);
+      current = bucket;
+      loaded = true;
+    }
+    if (!find_in_bucket(raw, key, list)) {
+      list.clear();
+    }
+    if (cache) {
+      cache->put(key, list);
+    }
+    fn(i, list);
+  }
+}
+
+// write one list as its own record, lists over the cap become stop keys
+void database::store_list(uint32_t key, const std::vector<fp_data_t> &value) {
+  // size of the record replaced, for the counters
+  unqlite_int64 old_bytes = 0;
+  bool existed = unqlite_kv_fetch(pDb, static_cast<void *>(&key), sizeof(key),
+                                  NULL, &old_bytes) == UNQLITE_OK;
+  if (!existed) {
+    old_bytes = 0;
+  }
+
+  if (over_cap(value.data(), value.size(), max_postings)) {
+    // list became too common, remove it and remember the key
+    rc = unqlite_kv_delete(pDb, static_cast<void *>(&key), sizeof(key));
+    add_stop_key(key);
+    if (existed) {
+      --delta.keys;
+    }
+    delta.postings -= old_bytes / sizeof(fp_data_t);
+    delta.bytes -= old_bytes;
+  } else {
+    rc = unqlite_kv_store(pDb, static_cast<void *>(&key), sizeof(key),
+                          value.data(), value.size() * sizeof(fp_data_t));
+    if (!existed) {
+      ++delta.keys;
+    }
+    delta.postings += value.size() - old_bytes / sizeof(fp_data_t);
+    delta.bytes += value.size() * sizeof(fp_data_t) - old_bytes;
+  }
+  stats_dirty = true;
+
+  // drop stale cached copy
+  if (cache) {
+    cache->erase(key);
+  }
+}
+
+uint32_t database::bucket_of(uint32_t key) const { return key >> bucket_bits; }
+
+bool database::read_bucket(uint32_t bucket, std::vector<uint8_t> &raw) {
+  unsigned char rkey[BUCKET_KEY_LEN];
+  bucket_record_key(bucket, rkey);
+
+  // rc is local so concurrent reads do not race
+  unqlite_int64 nBytes = 0;
+  int rc = unqlite_kv_fetch(pDb, rkey, BUCKET_KEY_LEN, NULL, &nBytes);
+  if (rc != UNQLITE_OK || nBytes < static_cast<unqlite_int64>(sizeof(uint32_t))) {
+    raw.clear();
+    return false;
+  }
+  raw.resize(nBytes);
+  unqlite_kv_fetch(pDb, rkey, BUCKET_KEY_LEN, raw.data(), &nBytes);
+  return true;
+}
+
+// a bucket record is the number of keys, their directory and then their
+// postings. empty buckets are removed. old is the record being replaced
+void database::write_bucket(
+    uint32_t bucket, const std::vector<uint8_t> &old,
+    const std::map<uint32_t, std::vector<fp_data_t>> &lists) {
+  uint64_t old_keys = 0;
+  uint64_t old_postings = 0;
+  bucket_totals(old, old_keys, old_postings);
+  delta.keys -= old_keys;
+  delta.postings -= old_postings;
+  delta.bytes -= old.size();
+  stats_dirty = true;
+
+  unsigned char rkey[BUCKET_KEY_LEN];
+  bucket_record_key(bucket, rkey);
+  if (lists.empty()) {
+    rc = unqlite_kv_delete(pDb, rkey, BUCKET_KEY_LEN);
+    return;
+  }
+
+  uint32_t n = lists.size();
+  std::vector<bucket_entry> dir;
+  uint32_t end = 0;
+  for (const auto &l : lists) {
+    end += l.second.size();
+    dir.push_back({l.first, end});
+  }
+
+  std::vector<uint8_t> raw(sizeof(n) + n * sizeof(bucket_entry) +
+                           end * sizeof(fp_data_t));
+  uint8_t *p = raw.data();
+  std::memcpy(p, &n, sizeof(n));
+  p += sizeof(n);
+  std::memcpy(p, dir.data(), n * sizeof(bucket_entry));
+  p += n * sizeof(bucket_entry);
+  for (const auto &l : lists) {
+    std::memcpy(p, l.second.data(), l.second.size() * sizeof(fp_data_t));
+    p += l.second.size() * sizeof(fp_data_t);
+  }
+
+  rc = unqlite_kv_store(pDb, rkey, BUCKET_KEY_LEN, raw.data(), raw.size());
+  delta.keys += n;
+  delta.postings += end;
+  delta.bytes += raw.size();
+}
+
+// number of keys and postings in a bucket record, read from its directory
+void database::bucket_totals(const std::vector<uint8_t> &raw, uint64_t &keys,
+                             uint64_t &postings) {
+  keys = 0;
+  postings = 0;
+  uint32_t n = 0;
+  if (raw.size() < sizeof(n)) {
+    return;
+  }
+  std::memcpy(&n, raw.data(), sizeof(n));
+  if (n == 0 || raw.size() < sizeof(n) + n * sizeof(bucket_entry)) {
+    return;
+  }
+  bucket_entry last;
+  std::memcpy(&last, raw.data() + sizeof(n) + (n - 1) * sizeof(last),
+              sizeof(last));
+  keys = n;
+  postings = last.end;
+}
+
+// binary search the directory of a bucket record for the list of key
+bool database::find_in_bucket(const std::vector<uint8_t> &raw, uint32_t key,
+                              std::vector<fp_data_t> &list) {
+  list.clear();
+  uint32_t n = 0;
+  if (raw.size() < sizeof(n)) {
+    return false;
+  }
+  std::memcpy(&n, raw.data(), sizeof(n));
+  size_t postings_offset = sizeof(n) + n * sizeof(bucket_entry);
+  if (raw.size() < postings_offset) {
+    return false;
+  }
+
+  const uint8_t *dir = raw.data() + sizeof(n);
+  auto entry = [dir](size_t i) {
+    bucket_entry e;
+    std::memcpy(&e, dir + i * sizeof(e), sizeof(e));
+    return e;
+  };
+  size_t lo = 0;
+  size_t hi = n;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (entry(mid).key < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == n || entry(lo).key != key) {
+    return false;
+  }
+
+  size_t begin = lo == 0 ? 0 : entry(lo - 1).end;
+  size_t end = entry(lo).end;
+  if (end < begin ||
+      postings_offset + end * sizeof(fp_data_t) > raw.size()) {
+    return false;
+  }
+  list.resize(end - begin);
+  std::memcpy(list.data(),
+              raw.data() + postings_offset + begin * sizeof(fp_data_t),
+              list.size() * sizeof(fp_data_t));
+  return true;
+}
+
+void database::decode_bucket(
+    const std::vector<uint8_t> &raw,
+    std::map<uint32_t, std::vector<fp_data_t>> &lists) {
+  uint32_t n = 0;
+  if (raw.size() < sizeof(n)) {
+    return;
+  }
+  std::memcpy(&n, raw.data(), sizeof(n));
+  size_t postings_offset = sizeof(n) + n * sizeof(bucket_entry);
+  if (raw.size() < postings_offset) {
+    return;
+  }
+
+  const fp_data_t *postings =
+      reinterpret_cast<const fp_data_t *>(raw.data() + postings_offset);
+  size_t max_end = (raw.size() - postings_offset) / sizeof(fp_data_t);
+  uint32_t begin = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    bucket_entry e;
+    std::memcpy(&e, raw.data() + sizeof(n) + i * sizeof(e), sizeof(e));
+    if (e.end < begin || e.end > max_end) {
+      return;
+    }
+    lists[e.key].assign(postings + begin, postings + e.end);
+    begin = e.end;
+  }
 }
 
 std::string database::get_song(std::array<unsigned char, 16> key) {
@@ -47,7 +456,7 @@ std::string database::get_song(std::array<unsigned char, 16> key) {
 
   // get size of return value
   unqlite_int64 nBytes;
-  rc =
+  int rc =
       unqlite_kv_fetch(pDb, static_cast<void *>(key.data()), 16, NULL, &nBytes);
   if (rc != UNQLITE_OK || nBytes == 0) {
     return ret;
@@ -57,8 +466,8 @@ std::string database::get_song(std::array<unsigned char, 16> key) {
   ret.resize(nBytes);
 
   // write value to a vector if a key is found
-  rc = unqlite_kv_fetch(pDb, static_cast<void *>(key.data()), 16, temp.data(),
-                        &nBytes);
+  unqlite_kv_fetch(pDb, static_cast<void *>(key.data()), 16, temp.data(),
+                   &nBytes);
 
   std::copy(temp.begin(), temp.end(), ret.begin());
   return ret;
@@ -66,7 +475,498 @@ std::string database::get_song(std::array<unsigned char, 16> key) {
 
 void database::put_song(std::array<unsigned char, 16> key,
                         const std::string &value) {
+  unqlite_int64 nBytes = 0;
+  if (unqlite_kv_fetch(pDb, static_cast<void *>(key.data()), 16, NULL,
+                       &nBytes) != UNQLITE_OK) {
+    ++delta.songs;
+    stats_dirty = true;
+  }
+
   // put value back into database
   rc = unqlite_kv_store(pDb, static_cast<void *>(key.data()), 16, value.c_str(),
                         value.length());
 }
+
+// remove the song name and forward index and tombstone the id, its
+// postings stay in the fingerprint index until it is compacted
+void database::delete_song(std::array<unsigned char, 16> key) {
+  forget_song(key);
+  if (tombstones.insert(key).second) {
+    rc = unqlite_kv_append(pDb, TOMBSTONES_KEY.c_str(), TOMBSTONES_KEY.length(),
+                           key.data(), 16);
+  }
+}
+
+// remove the song name and forward index without a tombstone, for songs
+// whose postings never reached an index
+void database::forget_song(std::array<unsigned char, 16> key) {
+  rc = unqlite_kv_delete(pDb, static_cast<void *>(key.data()), 16);
+  if (rc == UNQLITE_OK) {
+    --delta.songs;
+    stats_dirty = true;
+  }
+  delete_forward(key);
+}
+
+// store the fingerprints of a song sorted by time, replacing any stored
+// before. fingerprints before time 0 are dropped
+void database::put_forward(std::array<unsigned char, 16> key,
+                           std::vector<fp_t> fingerprints) {
+  delete_forward(key);
+  std::sort(fingerprints.begin(), fingerprints.end(),
+            [](const fp_t &a, const fp_t &b) {
+              return a.t < b.t || (a.t == b.t && a.fp < b.fp);
+            });
+  auto it = std::lower_bound(
+      fingerprints.begin(), fingerprints.end(), 0,
+      [](const fp_t &f, int32_t t) { return f.t < t; });
+
+  unsigned char rkey[FORWARD_BLOCK_KEY_LEN];
+  uint32_t num_blocks = 0;
+  while (it != fingerprints.end()) {
+    uint32_t block = it->t / FORWARD_BLOCK;
+    auto block_end = std::lower_bound(
+        it, fingerprints.end(),
+        static_cast<int32_t>((block + 1) * FORWARD_BLOCK),
+        [](const fp_t &f, int32_t t) { return f.t < t; });
+    forward_record_key(key, block, rkey);
+    rc = unqlite_kv_store(pDb, rkey, FORWARD_BLOCK_KEY_LEN, &*it,
+                          (block_end - it) * sizeof(fp_t));
+    num_blocks = block + 1;
+    it = block_end;
+  }
+
+  forward_record_key(key, 0, rkey);
+  rc = unqlite_kv_store(pDb, rkey, FORWARD_KEY_LEN, &num_blocks,
+                        sizeof(num_blocks));
+}
+
+// fingerprints of a song with t_begin <= t < t_end in time order, read
+// from the blocks overlapping the window only. false if the song has no
+// forward index
+bool database::get_forward(std::array<unsigned char, 16> key, int32_t t_begin,
+                           int32_t t_end, std::vector<fp_t> &fingerprints) {
+  fingerprints.clear();
+
+  unsigned char rkey[FORWARD_BLOCK_KEY_LEN];
+  forward_record_key(key, 0, rkey);
+  uint32_t num_blocks = 0;
+  unqlite_int64 nBytes = sizeof(num_blocks);
+  int rc = unqlite_kv_fetch(pDb, rkey, FORWARD_KEY_LEN, &num_blocks, &nBytes);
+  if (rc != UNQLITE_OK) {
+    return false;
+  }
+
+  t_begin = std::max(t_begin, 0);
+  if (t_end <= t_begin) {
+    return true;
+  }
+  uint32_t last = std::min<uint32_t>((t_end - 1) / FORWARD_BLOCK + 1,
+                                     num_blocks);
+  std::vector<uint8_t> raw;
+  for (uint32_t block = t_begin / FORWARD_BLOCK; block < last; ++block) {
+    forward_record_key(key, block, rkey);
+    nBytes = 0;
+    if (unqlite_kv_fetch(pDb, rkey, FORWARD_BLOCK_KEY_LEN, NULL, &nBytes) !=
+            UNQLITE_OK ||
+        nBytes == 0) {
+      continue;
+    }
+    raw.resize(nBytes);
+    unqlite_kv_fetch(pDb, rkey, FORWARD_BLOCK_KEY_LEN, raw.data(), &nBytes);
+
+    for (size_t i = 0; i + sizeof(fp_t) <= raw.size(); i += sizeof(fp_t)) {
+      uint32_t fp;
+      int32_t t;
+      std::memcpy(&fp, raw.data() + i, sizeof(fp));
+      std::memcpy(&t, raw.data() + i + sizeof(fp), sizeof(t));
+      if (t >= t_begin && t < t_end) {
+        fingerprints.emplace_back(fp, t);
+      }
+    }
+  }
+  return true;
+}
+
+void database::delete_forward(std::array<unsigned char, 16> key) {
+  unsigned char rkey[FORWARD_BLOCK_KEY_LEN];
+  forward_record_key(key, 0, rkey);
+  uint32_t num_blocks = 0;
+  unqlite_int64 nBytes = sizeof(num_blocks);
+  if (unqlite_kv_fetch(pDb, rkey, FORWARD_KEY_LEN, &num_blocks, &nBytes) !=
+      UNQLITE_OK) {
+    return;
+  }
+
+  for (uint32_t block = 0; block < num_blocks; ++block) {
+    forward_record_key(key, block, rkey);
+    unqlite_kv_delete(pDb, rkey, FORWARD_BLOCK_KEY_LEN);
+  }
+  forward_record_key(key, 0, rkey);
+  rc = unqlite_kv_delete(pDb, rkey, FORWARD_KEY_LEN);
+}
+
+bool database::is_deleted(const uint8_t *id) const {
+  if (tombstones.empty()) {
+    return false;
+  }
+
+  std::array<unsigned char, 16> key;
+  std::copy(id, id + 16, key.begin());
+  return tombstones.find(key) != tombstones.end();
+}
+
+std::set<std::array<unsigned char, 16>> database::get_tombstones() const {
+  return tombstones;
+}
+
+void database::clear_tombstones() {
+  tombstones.clear();
+  rc = unqlite_kv_delete(pDb, TOMBSTONES_KEY.c_str(), TOMBSTONES_KEY.length());
+}
+
+// write out the changes made so far. false if they could not be written,
+// as while another process such as identify has the file open
+bool database::commit() {
+  if (stats_dirty) {
+    save_stats();
+  }
+  return unqlite_commit(pDb) == UNQLITE_OK;
+}
+
+uint64_t database::cache_hits() const { return cache ? cache->hits() : 0; }
+
+uint64_t database::cache_misses() const {
+  return cache ? cache->misses() : 0;
+}
+
+// lists stored before the cap was set or lowered are checked once here,
+// so lookups never have to
+void database::set_max_postings(size_t max_postings) {
+  bool changed = max_postings != this->max_postings;
+  this->max_postings = max_postings;
+  if (changed && max_postings > 0) {
+    std::vector<uint32_t> over;
+    scan_fp([max_postings, &over](uint32_t key,
+                                  const std::vector<fp_data_t> &list) {
+      if (over_cap(list.data(), list.size(), max_postings)) {
+        over.push_back(key);
+      }
+    });
+    for (uint32_t key : over) {
+      if (bucket_bits > 0) {
+        put_fp_list(key, fetch_fp(key));
+      } else {
+        store_list(key, fetch_fp(key));
+      }
+      if (cache) {
+        cache->erase(key);
+      }
+    }
+  }
+
+  uint64_t temp = max_postings;
+  rc = unqlite_kv_store(pDb, MAX_POSTINGS_KEY.c_str(), MAX_POSTINGS_KEY.length(),
+                        &temp, sizeof(temp));
+}
+
+size_t database::get_max_postings() const { return max_postings; }
+
+// group keys sharing all but their low bucket_bits bits into one record.
+// only takes effect for lists written from now on, so it is set on a new
+// index, mask_compact rewrites an existing one
+void database::set_bucket_bits(size_t bucket_bits) {
+  this->bucket_bits = bucket_bits;
+
+  uint64_t temp = bucket_bits;
+  rc = unqlite_kv_store(pDb, BUCKET_BITS_KEY.c_str(), BUCKET_BITS_KEY.length(),
+                        &temp, sizeof(temp));
+}
+
+size_t database::get_bucket_bits() const { return bucket_bits; }
+
+// counters as of the last commit plus this handle's pending changes, false
+// if the file was written before it kept counters
+bool database::get_stats(catalogue_stats &stats) const {
+  if (!read_stats(stats)) {
+    if (!empty_at_open) {
+      return false;
+    }
+    stats = {0, 0, 0, 0};
+  }
+  stats.songs += delta.songs;
+  stats.keys += delta.keys;
+  stats.postings += delta.postings;
+  stats.bytes += delta.bytes;
+  return true;
+}
+
+// count every record with one pass over the file and store the counters,
+// for files written before they were kept
+void database::recount_stats() {
+  catalogue_stats stats = {0, 0, 0, 0};
+  unqlite_kv_cursor *cursor;
+  rc = unqlite_kv_cursor_init(pDb, &cursor);
+  if (rc != UNQLITE_OK) {
+    return;
+  }
+
+  std::vector<uint8_t> raw;
+  for (unqlite_kv_cursor_first_entry(cursor);
+       unqlite_kv_cursor_valid_entry(cursor);
+       unqlite_kv_cursor_next_entry(cursor)) {
+    int nKey = 0;
+    unqlite_kv_cursor_key(cursor, NULL, &nKey);
+    unqlite_int64 nBytes = 0;
+    unqlite_kv_cursor_data(cursor, NULL, &nBytes);
+    if (nKey == 16) {
+      ++stats.songs;
+    } else if (nKey == sizeof(uint32_t)) {
+      ++stats.keys;
+      stats.postings += nBytes / sizeof(fp_data_t);
+      stats.bytes += nBytes;
+    } else if (nKey == BUCKET_KEY_LEN) {
+      unsigned char rkey[BUCKET_KEY_LEN];
+      unqlite_kv_cursor_key(cursor, rkey, &nKey);
+      if (rkey[0] != 'b') {
+        continue;
+      }
+      raw.resize(nBytes);
+      unqlite_kv_cursor_data(cursor, raw.data(), &nBytes);
+      uint64_t keys = 0;
+      uint64_t postings = 0;
+      bucket_totals(raw, keys, postings);
+      stats.keys += keys;
+      stats.postings += postings;
+      stats.bytes += nBytes;
+    }
+  }
+  unqlite_kv_cursor_release(pDb, cursor);
+
+  delta = stats;
+  empty_at_open = true;
+  rc = unqlite_kv_delete(pDb, STATS_KEY.c_str(), STATS_KEY.length());
+  save_stats();
+}
+
+bool database::is_stop_key(uint32_t key) const {
+  return stop_keys.find(key) != stop_keys.end();
+}
+
+size_t database::num_stop_keys() const { return stop_keys.size(); }
+
+std::vector<uint32_t> database::get_stop_keys() const {
+  return std::vector<uint32_t>(stop_keys.begin(), stop_keys.end());
+}
+
+// read stop list, posting cap and bucket layout written by ingest
+void database::load_stop_keys() {
+  uint64_t temp = 0;
+  unqlite_int64 nBytes = sizeof(temp);
+  if (unqlite_kv_fetch(pDb, MAX_POSTINGS_KEY.c_str(), MAX_POSTINGS_KEY.length(),
+                       &temp, &nBytes) == UNQLITE_OK) {
+    max_postings = temp;
+  }
+
+  temp = 0;
+  nBytes = sizeof(temp);
+  if (unqlite_kv_fetch(pDb, BUCKET_BITS_KEY.c_str(), BUCKET_BITS_KEY.length(),
+                       &temp, &nBytes) == UNQLITE_OK) {
+    bucket_bits = temp;
+  }
+
+  nBytes = 0;
+  if (unqlite_kv_fetch(pDb, STOP_KEYS_KEY.c_str(), STOP_KEYS_KEY.length(), NULL,
+                       &nBytes) != UNQLITE_OK ||
+      nBytes == 0) {
+    return;
+  }
+
+  std::vector<uint32_t> keys(nBytes / sizeof(uint32_t));
+  unqlite_kv_fetch(pDb, STOP_KEYS_KEY.c_str(), STOP_KEYS_KEY.length(),
+                   keys.data(), &nBytes);
+  stop_keys.insert(keys.begin(), keys.end());
+}
+
+void database::add_stop_key(uint32_t key) {
+  if (!stop_keys.insert(key).second) {
+    return;
+  }
+  rc = unqlite_kv_append(pDb, STOP_KEYS_KEY.c_str(), STOP_KEYS_KEY.length(),
+                         &key, sizeof(key));
+  if (cache) {
+    cache->erase(key);
+  }
+}
+
+// call fn for every posting list in the database, skipping metadata records
+// and, unless skip_stop is false, stop keys
+void database::scan_fp(
+    const std::function<void(uint32_t, const std::vector<fp_data_t> &)> &fn,
+    bool skip_stop) {
+  unqlite_kv_cursor *cursor;
+  rc = unqlite_kv_cursor_init(pDb, &cursor);
+  if (rc != UNQLITE_OK) {
+    return;
+  }
+
+  std::vector<fp_data_t> value;
+  std::vector<uint8_t> raw;
+  std::map<uint32_t, std::vector<fp_data_t>> bucket_lists;
+  for (unqlite_kv_cursor_first_entry(cursor);
+       unqlite_kv_cursor_valid_entry(cursor);
+       unqlite_kv_cursor_next_entry(cursor)) {
+    // fingerprint keys are exactly 4 bytes long, bucket keys 5
+    int nKey = 0;
+    unqlite_kv_cursor_key(cursor, NULL, &nKey);
+    if (nKey == BUCKET_KEY_LEN) {
+      unsigned char rkey[BUCKET_KEY_LEN];
+      unqlite_kv_cursor_key(cursor, rkey, &nKey);
+      if (rkey[0] != 'b') {
+        continue;
+      }
+      unqlite_int64 nBytes = 0;
+      unqlite_kv_cursor_data(cursor, NULL, &nBytes);
+      raw.resize(nBytes);
+      unqlite_kv_cursor_data(cursor, raw.data(), &nBytes);
+      bucket_lists.clear();
+      decode_bucket(raw, bucket_lists);
+      for (const auto &l : bucket_lists) {
+        if (skip_stop && is_stop_key(l.first)) {
+          continue;
+        }
+        fn(l.first, l.second);
+      }
+      continue;
+    }
+    if (nKey != sizeof(uint32_t)) {
+      continue;
+    }
+    uint32_t key;
+    unqlite_kv_cursor_key(cursor, &key, &nKey);
+    if (skip_stop && is_stop_key(key)) {
+      continue;
+    }
+
+    unqlite_int64 nBytes = 0;
+    unqlite_kv_cursor_data(cursor, NULL, &nBytes);
+    value.resize(nBytes / sizeof(fp_data_t));
+    unqlite_kv_cursor_data(cursor, value.data(), &nBytes);
+
+    fn(key, value);
+  }
+
+  unqlite_kv_cursor_release(pDb, cursor);
+}
+
+// call fn for every song name in the database
+void database::scan_songs(
+    const std::function<void(const std::array<unsigned char, 16> &,
+                             const std::string &)> &fn) {
+  unqlite_kv_cursor *cursor;
+  rc = unqlite_kv_cursor_init(pDb, &cursor);
+  if (rc != UNQLITE_OK) {
+    return;
+  }
+
+  std::array<unsigned char, 16> id;
+  std::string name;
+  for (unqlite_kv_cursor_first_entry(cursor);
+       unqlite_kv_cursor_valid_entry(cursor);
+       unqlite_kv_cursor_next_entry(cursor)) {
+    // song ids are exactly 16 bytes long
+    int nKey = 0;
+    unqlite_kv_cursor_key(cursor, NULL, &nKey);
+    if (nKey != 16) {
+      continue;
+    }
+    unqlite_kv_cursor_key(cursor, id.data(), &nKey);
+
+    unqlite_int64 nBytes = 0;
+    unqlite_kv_cursor_data(cursor, NULL, &nBytes);
+    name.resize(nBytes);
+    unqlite_kv_cursor_data(cursor, &name[0], &nBytes);
+
+    fn(id, name);
+  }
+
+  unqlite_kv_cursor_release(pDb, cursor);
+}
+
+bool database::read_stats(catalogue_stats &stats) const {
+  unqlite_int64 nBytes = sizeof(stats);
+  return unqlite_kv_fetch(pDb, STATS_KEY.c_str(), STATS_KEY.length(), &stats,
+                          &nBytes) == UNQLITE_OK &&
+         nBytes == sizeof(stats);
+}
+
+// add the pending changes to the stored counters. they are read again
+// here, as another writer may have committed since this handle was opened
+void database::save_stats() {
+  catalogue_stats stats;
+  if (!get_stats(stats)) {
+    return;
+  }
+  rc = unqlite_kv_store(pDb, STATS_KEY.c_str(), STATS_KEY.length(), &stats,
+                        sizeof(stats));
+  delta = {0, 0, 0, 0};
+  stats_dirty = false;
+}
+
+bool database::is_empty() {
+  unqlite_kv_cursor *cursor;
+  if (unqlite_kv_cursor_init(pDb, &cursor) != UNQLITE_OK) {
+    return true;
+  }
+  unqlite_kv_cursor_first_entry(cursor);
+  bool empty = !unqlite_kv_cursor_valid_entry(cursor);
+  unqlite_kv_cursor_release(pDb, cursor);
+  return empty;
+}
+
+// read ids of deleted songs
+void database::load_tombstones() {
+  unqlite_int64 nBytes = 0;
+  if (unqlite_kv_fetch(pDb, TOMBSTONES_KEY.c_str(), TOMBSTONES_KEY.length(),
+                       NULL, &nBytes) != UNQLITE_OK ||
+      nBytes == 0) {
+    return;
+  }
+
+  std::vector<std::array<unsigned char, 16>> ids(nBytes / 16);
+  unqlite_kv_fetch(pDb, TOMBSTONES_KEY.c_str(), TOMBSTONES_KEY.length(),
+                   ids.data(), &nBytes);
+  tombstones.insert(ids.begin(), ids.end());
+}
+
+size_t file_size(const std::string &path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return 0;
+  }
+  return st.st_size;
+}
+
+size_t count_songs(const fp_data_t *list, size_t n, size_t limit) {
+  std::set<std::array<unsigned char, 16>> ids;
+  for (size_t i = 0; i < n && ids.size() <= limit; ++i) {
+    // postings of one song are mostly adjacent
+    if (i > 0 && std::memcmp(list[i].id, list[i - 1].id, 16) == 0) {
+      continue;
+    }
+    std::array<unsigned char, 16> id;
+    std::copy(list[i].id, list[i].id + 16, id.begin());
+    ids.insert(id);
+  }
+  return ids.size();
+}
+
+// a key is too common once it occurs in more than max_postings songs, a
+// song repeating a key a few times does not make it a stop key. the list
+// length bounds the song count, so short lists are never scanned. only
+// writes check this, readers just skip the stop keys
+bool over_cap(const fp_data_t *list, size_t n, size_t max_postings) {
+  return max_postings > 0 && n > max_postings &&
+         (n > MAX_KEY_REPEATS * max_postings ||
+          count_songs(list, n, max_postings) > max_postings);
+}
@@ -2,28 +2,136 @@
 #define _DATABASE_H
 
 #include <iostream>
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <numeric>
 #include <string>
 #include <vector>
 #include <array>
+#include <functional>
+#include <memory>
+#include <map>
+#include <set>
+#include <unordered_set>
+#include <utility>
+#include <sys/stat.h>
 
+#include "posting_cache.hpp"
 #include "types.hpp"
 
 extern "C" {
 #include "unqlite/unqlite.h"
 }
 
+// a list is a stop key at MAX_KEY_REPEATS times the posting cap even if
+// few songs make it up
+static constexpr size_t MAX_KEY_REPEATS = 8;
+
+// directory entry of a bucket record. the lists of a bucket follow its
+// directory in key order, end is one past the last posting of the key
+struct bucket_entry {
+  uint32_t key;
+  uint32_t end;
+};
+
+// running totals of the records in one database file: song names, posting
+// lists and their postings, and the bytes the posting records take
+struct catalogue_stats {
+  uint64_t songs;
+  uint64_t keys;
+  uint64_t postings;
+  uint64_t bytes;
+};
+
 class database {
   public:
-    database(const std::string filename);
+    database(const std::string filename, size_t cache_bytes = 0,
+             bool read_only = false);
     ~database();
     std::vector<fp_data_t> get_fp(uint32_t key);
     void put_fp(uint32_t key, const fp_data_t& value);
+    void put_fp_list(uint32_t key, const std::vector<fp_data_t> &value);
+    void append_fp_lists(
+        const std::vector<std::pair<uint32_t, std::vector<fp_data_t>>>
+            &lists);
+    void get_fp_batch(
+        const uint32_t *keys, size_t n,
+        const std::function<void(size_t, const std::vector<fp_data_t> &)>
+            &fn);
     std::string get_song(std::array<unsigned char, 16> key);
     void put_song(std::array<unsigned char, 16> key, const std::string &value);
+    void delete_song(std::array<unsigned char, 16> key);
+    void forget_song(std::array<unsigned char, 16> key);
+    void put_forward(std::array<unsigned char, 16> key,
+                     std::vector<fp_t> fingerprints);
+    bool get_forward(std::array<unsigned char, 16> key, int32_t t_begin,
+                     int32_t t_end, std::vector<fp_t> &fingerprints);
+    void delete_forward(std::array<unsigned char, 16> key);
+    bool is_deleted(const uint8_t *id) const;
+    std::set<std::array<unsigned char, 16>> get_tombstones() const;
+    void clear_tombstones();
+    bool commit();
+    uint64_t cache_hits() const;
+    uint64_t cache_misses() const;
+    void set_max_postings(size_t max_postings);
+    size_t get_max_postings() const;
+    void set_bucket_bits(size_t bucket_bits);
+    size_t get_bucket_bits() const;
+    static constexpr size_t MAX_BUCKET_BITS = 16;
+    static constexpr int32_t FORWARD_BLOCK = 256;
+    bool get_stats(catalogue_stats &stats) const;
+    void recount_stats();
+    bool is_stop_key(uint32_t key) const;
+    size_t num_stop_keys() const;
+    std::vector<uint32_t> get_stop_keys() const;
+    void add_stop_key(uint32_t key);
+    void scan_fp(
+        const std::function<void(uint32_t, const std::vector<fp_data_t> &)>
+            &fn,
+        bool skip_stop = true);
+    void scan_songs(
+        const std::function<void(const std::array<unsigned char, 16> &,
+                                 const std::string &)> &fn);
   private:
+    std::vector<fp_data_t> fetch_fp(uint32_t key);
+    void store_list(uint32_t key, const std::vector<fp_data_t> &value);
+    uint32_t bucket_of(uint32_t key) const;
+    bool read_bucket(uint32_t bucket, std::vector<uint8_t> &raw);
+    void write_bucket(uint32_t bucket, const std::vector<uint8_t> &old,
+                      const std::map<uint32_t, std::vector<fp_data_t>> &lists);
+    static void bucket_totals(const std::vector<uint8_t> &raw, uint64_t &keys,
+                              uint64_t &postings);
+    static bool find_in_bucket(const std::vector<uint8_t> &raw, uint32_t key,
+                               std::vector<fp_data_t> &list);
+    static void
+    decode_bucket(const std::vector<uint8_t> &raw,
+                  std::map<uint32_t, std::vector<fp_data_t>> &lists);
+    void load_stop_keys();
+    void load_tombstones();
+    bool read_stats(catalogue_stats &stats) const;
+    void save_stats();
+    bool is_empty();
+
     unqlite *pDb;
     int rc;
+    std::unique_ptr<posting_cache> cache;
+    std::unordered_set<uint32_t> stop_keys;
+    std::set<std::array<unsigned char, 16>> tombstones;
+    size_t max_postings;
+    size_t bucket_bits;
+    catalogue_stats delta;
+    bool stats_dirty;
+    bool empty_at_open;
 };
 
+// size of the file at path, 0 if it does not exist
+size_t file_size(const std::string &path);
+
+// number of distinct songs in a posting list, counting stops past limit
+size_t count_songs(const fp_data_t *list, size_t n, size_t limit);
+
+// whether a list is too common to keep under the posting cap max_postings
+bool over_cap(const fp_data_t *list, size_t n, size_t max_postings);
+
 #endif
@@ -0,0 +1,33 @@
+#include "decision.hpp"
+
+// whether the votes after elapsed name a song by the given rule
+bool decide(const vote_table &votes, int elapsed, decision_rule rule) {
+  int score = votes.best_score();
+  switch (rule) {
+  case decision_rule::rate: {
+    double seconds = elapsed * 10 / 1000.0;
+    double needed =
+        THRESHOLD_RATE_MIN +
+        THRESHOLD_RATE * std::max(0.0, seconds - THRESHOLD_RATE_MIN_TIME);
+    return score >= std::min<double>(needed, THRESHOLD);
+  }
+  case decision_rule::likelihood:
+    return score >= MIN_SCORE &&
+           votes.background_log10() <= FALSE_ALARM_LOG10;
+  default:
+    return score >= THRESHOLD;
+  }
+}
+
+bool parse_rule(const std::string &name, decision_rule &rule) {
+  if (name == "threshold") {
+    rule = decision_rule::threshold;
+  } else if (name == "rate") {
+    rule = decision_rule::rate;
+  } else if (name == "likelihood") {
+    rule = decision_rule::likelihood;
+  } else {
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,29 @@
+#ifndef _DECISION_H
+#define _DECISION_H
+
+#include <algorithm>
+#include <string>
+
+#include "vote_table.hpp"
+
+static constexpr int THRESHOLD = 8;
+
+// with the rate rule a song is accepted at THRESHOLD_RATE_MIN votes, the
+// score needed rising by THRESHOLD_RATE a second after
+// THRESHOLD_RATE_MIN_TIME seconds up to THRESHOLD, as in the python tool
+static constexpr int THRESHOLD_RATE_MIN = 6;
+static constexpr double THRESHOLD_RATE = 0.25;
+static constexpr int THRESHOLD_RATE_MIN_TIME = 3;
+// with the likelihood rule a song is accepted once fewer than
+// 10^FALSE_ALARM_LOG10 song and offset pairs are expected to score as well
+// by chance, and it has at least MIN_SCORE votes
+static constexpr double FALSE_ALARM_LOG10 = -4;
+static constexpr int MIN_SCORE = 4;
+
+// when the votes so far are enough to name the song
+enum class decision_rule { threshold, rate, likelihood };
+
+bool decide(const vote_table &votes, int elapsed, decision_rule rule);
+bool parse_rule(const std::string &name, decision_rule &rule);
+
+#endif
@@ -0,0 +1,289 @@
+#include "elias_fano.hpp"
+
+// the encoding is HEADER_WORDS words {n, low bits, length of the high bit
+// vector, universe}, then the low bits, the high bits, the one samples and
+// the zero samples. low and high bits get a spare word, so reads of two
+// neighbouring words never leave the array
+
+elias_fano::cursor::cursor(const elias_fano &ef)
+    : ef(ef), i(0), word(0), bits(ef.n > 0 ? ef.high[0] : 0) {}
+
+uint64_t elias_fano::cursor::next() {
+  while (bits == 0) {
+    bits = ef.high[++word];
+  }
+  size_t p = word * 64 + __builtin_ctzll(bits);
+  bits &= bits - 1;
+  uint64_t value =
+      (static_cast<uint64_t>(p - i) << ef.low_bits) | ef.low_of(i);
+  ++i;
+  return value;
+}
+
+elias_fano::elias_fano()
+    : words(nullptr), n_words(0), n(0), low_bits(0), high_len(0),
+      low(nullptr), high(nullptr), ones(nullptr), zeros(nullptr) {}
+
+// encode value(0) <= value(1) <= ... <= value(n - 1)
+void elias_fano::build(size_t n,
+                       const std::function<uint64_t(size_t)> &value) {
+  uint64_t universe = n > 0 ? value(n - 1) + 1 : 1;
+  uint64_t low_bits = 0;
+  while (n > 0 && (universe >> (low_bits + 1)) >= n) {
+    ++low_bits;
+  }
+  uint64_t high_len = n + ((universe - 1) >> low_bits) + 1;
+
+  size_t low_words, high_words, one_samples, zero_samples;
+  owned.assign(words_needed(n, low_bits, high_len, low_words, high_words,
+                            one_samples, zero_samples),
+               0);
+  owned[0] = n;
+  owned[1] = low_bits;
+  owned[2] = high_len;
+  owned[3] = universe;
+  words = owned.data();
+  n_words = owned.size();
+  this->n = n;
+  this->low_bits = low_bits;
+  this->high_len = high_len;
+  set_pointers(low_words, high_words, one_samples);
+
+  uint64_t *low_out = owned.data() + HEADER_WORDS;
+  uint64_t *high_out = low_out + low_words;
+  uint64_t *ones_out = high_out + high_words;
+  uint64_t *zeros_out = ones_out + one_samples;
+  uint64_t low_mask = low_bits == 0 ? 0 : (~0ull >> (64 - low_bits));
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t v = value(i);
+    if (low_bits > 0) {
+      uint64_t pos = i * low_bits;
+      uint64_t bits = v & low_mask;
+      low_out[pos / 64] |= bits << (pos % 64);
+      if (pos % 64 + low_bits > 64) {
+        low_out[pos / 64 + 1] |= bits >> (64 - pos % 64);
+      }
+    }
+    uint64_t p = (v >> low_bits) + i;
+    high_out[p / 64] |= 1ull << (p % 64);
+    if (i % SAMPLE == 0) {
+      ones_out[i / SAMPLE] = p;
+    }
+  }
+
+  // the zeros end the runs of equal high bits
+  size_t z = 0;
+  for (uint64_t p = 0; p < high_len; ++p) {
+    if ((high_out[p / 64] >> (p % 64) & 1) == 0) {
+      if (z % SAMPLE == 0) {
+        zeros_out[z / SAMPLE] = p;
+      }
+      ++z;
+    }
+  }
+}
+
+// use an encoding written by build() in place, false if it does not fit
+bool elias_fano::attach(const uint64_t *words, size_t n_words) {
+  if (n_words < HEADER_WORDS) {
+    return false;
+  }
+  uint64_t n = words[0];
+  uint64_t low_bits = words[1];
+  uint64_t high_len = words[2];
+  if (low_bits >= 64 || high_len < n || high_len - n > (1ull << 58) ||
+      n > (1ull << 58)) {
+    return false;
+  }
+  size_t low_words, high_words, one_samples, zero_samples;
+  size_t needed = words_needed(n, low_bits, high_len, low_words, high_words,
+                               one_samples, zero_samples);
+  if (needed > n_words) {
+    return false;
+  }
+
+  owned.clear();
+  this->words = words;
+  this->n_words = needed;
+  this->n = n;
+  this->low_bits = low_bits;
+  this->high_len = high_len;
+  set_pointers(low_words, high_words, one_samples);
+  if (!check_high_bits()) {
+    clear();
+    return false;
+  }
+  return true;
+}
+
+void elias_fano::clear() {
+  owned.clear();
+  words = nullptr;
+  n_words = 0;
+  n = 0;
+  low_bits = 0;
+  high_len = 0;
+  low = high = ones = zeros = nullptr;
+}
+
+size_t elias_fano::size() const { return n; }
+
+uint64_t elias_fano::get(size_t i) const {
+  return (static_cast<uint64_t>(select1(i) - i) << low_bits) | low_of(i);
+}
+
+// values i and i + 1, the second found by scanning on from the first
+void elias_fano::get_pair(size_t i, uint64_t &first,
+                          uint64_t &second) const {
+  size_t p = select1(i);
+  first = (static_cast<uint64_t>(p - i) << low_bits) | low_of(i);
+
+  size_t word = p / 64;
+  uint64_t bits = high[word] & (~1ull << (p % 64));
+  while (bits == 0) {
+    bits = high[++word];
+  }
+  size_t q = word * 64 + __builtin_ctzll(bits);
+  second = (static_cast<uint64_t>(q - i - 1) << low_bits) | low_of(i + 1);
+}
+
+// index of value, NOT_FOUND if it is not in the sequence
+size_t elias_fano::find(uint64_t value) const {
+  bool equal;
+  size_t i = search(value, equal);
+  return equal ? i : NOT_FOUND;
+}
+
+// index of the first value not below value, size() if there is none
+size_t elias_fano::lower_bound(uint64_t value) const {
+  bool equal;
+  return search(value, equal);
+}
+
+const uint64_t *elias_fano::data() const { return words; }
+
+size_t elias_fano::num_words() const { return n_words; }
+
+size_t elias_fano::words_needed(uint64_t n, uint64_t low_bits,
+                                uint64_t high_len, size_t &low_words,
+                                size_t &high_words, size_t &one_samples,
+                                size_t &zero_samples) {
+  low_words = (n * low_bits + 63) / 64 + 1;
+  high_words = (high_len + 63) / 64 + 1;
+  one_samples = n / SAMPLE + 1;
+  zero_samples = (high_len - n) / SAMPLE + 1;
+  return HEADER_WORDS + low_words + high_words + one_samples + zero_samples;
+}
+
+// position of the r-th set bit of w
+size_t elias_fano::select_in_word(uint64_t w, size_t r) {
+  for (; r > 0; --r) {
+    w &= w - 1;
+  }
+  return __builtin_ctzll(w);
+}
+
+// the selects trust the high bits and samples to stay within the array,
+// so an attached encoding must hold n ones, no bits past high_len, and
+// samples at the positions build() puts them. one pass over the high bits
+bool elias_fano::check_high_bits() const {
+  size_t high_words = (high_len + 63) / 64 + 1;
+  uint64_t n_ones = 0, n_zeros = 0;
+  for (size_t w = 0; w < high_words; ++w) {
+    uint64_t valid = 0;
+    if (w * 64 < high_len) {
+      valid = high_len - w * 64 >= 64 ? ~0ull
+                                      : (1ull << (high_len - w * 64)) - 1;
+    }
+    if (high[w] & ~valid) {
+      return false;
+    }
+    for (uint64_t b = high[w]; b != 0; b &= b - 1, ++n_ones) {
+      if (n_ones % SAMPLE == 0 &&
+          (n_ones >= n ||
+           ones[n_ones / SAMPLE] != w * 64 + __builtin_ctzll(b))) {
+        return false;
+      }
+    }
+    for (uint64_t b = ~high[w] & valid; b != 0; b &= b - 1, ++n_zeros) {
+      if (n_zeros % SAMPLE == 0 &&
+          zeros[n_zeros / SAMPLE] != w * 64 + __builtin_ctzll(b)) {
+        return false;
+      }
+    }
+  }
+  return n_ones == n;
+}
+
+void elias_fano::set_pointers(size_t low_words, size_t high_words,
+                              size_t one_samples) {
+  low = words + HEADER_WORDS;
+  high = low + low_words;
+  ones = high + high_words;
+  zeros = ones + one_samples;
+}
+
+uint64_t elias_fano::low_of(size_t i) const {
+  if (low_bits == 0) {
+    return 0;
+  }
+  uint64_t pos = i * low_bits;
+  uint64_t bits = low[pos / 64] >> (pos % 64);
+  if (pos % 64 + low_bits > 64) {
+    bits |= low[pos / 64 + 1] << (64 - pos % 64);
+  }
+  return bits & (~0ull >> (64 - low_bits));
+}
+
+// position of the i-th one, starting at the sample before it
+size_t elias_fano::select1(size_t i) const {
+  size_t p = ones[i / SAMPLE];
+  size_t r = i % SAMPLE;
+  size_t word = p / 64;
+  uint64_t bits = high[word] & (~0ull << (p % 64));
+  for (;;) {
+    size_t c = __builtin_popcountll(bits);
+    if (r < c) {
+      return word * 64 + select_in_word(bits, r);
+    }
+    r -= c;
+    bits = high[++word];
+  }
+}
+
+// position of the i-th zero
+size_t elias_fano::select0(size_t i) const {
+  size_t p = zeros[i / SAMPLE];
+  size_t r = i % SAMPLE;
+  size_t word = p / 64;
+  uint64_t bits = ~high[word] & (~0ull << (p % 64));
+  for (;;) {
+    size_t c = __builtin_popcountll(bits);
+    if (r < c) {
+      return word * 64 + select_in_word(bits, r);
+    }
+    r -= c;
+    bits = ~high[++word];
+  }
+}
+
+// the values with high bits h are the ones between the (h - 1)-th and
+// h-th zero, compare their low bits in order
+size_t elias_fano::search(uint64_t value, bool &equal) const {
+  equal = false;
+  uint64_t h = value >> low_bits;
+  if (n == 0 || h >= high_len - n) {
+    return n;
+  }
+  size_t p = h == 0 ? 0 : select0(h - 1) + 1;
+  size_t i = p - h;
+  uint64_t target = low_bits == 0 ? 0 : value & (~0ull >> (64 - low_bits));
+  for (; i < n && (high[p / 64] >> (p % 64) & 1); ++i, ++p) {
+    uint64_t l = low_of(i);
+    if (l >= target) {
+      equal = l == target;
+      return i;
+    }
+  }
+  return i;
+}
@@ -0,0 +1,75 @@
+#ifndef _ELIAS_FANO_H
+#define _ELIAS_FANO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// non-decreasing sequence of integers in elias-fano coding. each value is
+// split into low bits, stored verbatim, and high bits, stored in unary as
+// runs of ones in one bit vector, for about 2 + log2(universe / n) bits per
+// value. the position of every SAMPLE-th one and zero of that vector is
+// kept, so reading the i-th value or searching for a value scans only a
+// few words. the encoding is a flat array of words, owned after build()
+// or used in place after attach(), e.g. inside a mapped file
+class elias_fano {
+  public:
+    // sequential reader, next() returns the values in order
+    class cursor {
+      public:
+        cursor(const elias_fano &ef);
+        uint64_t next();
+
+      private:
+        const elias_fano &ef;
+        size_t i;
+        size_t word;
+        uint64_t bits;
+    };
+
+    elias_fano();
+    elias_fano(const elias_fano &) = delete;
+    elias_fano &operator=(const elias_fano &) = delete;
+    void build(size_t n, const std::function<uint64_t(size_t)> &value);
+    bool attach(const uint64_t *words, size_t n_words);
+    void clear();
+    size_t size() const;
+    uint64_t get(size_t i) const;
+    void get_pair(size_t i, uint64_t &first, uint64_t &second) const;
+    size_t find(uint64_t value) const;
+    size_t lower_bound(uint64_t value) const;
+    const uint64_t *data() const;
+    size_t num_words() const;
+
+    static constexpr size_t SAMPLE = 256;
+    static constexpr size_t HEADER_WORDS = 4;
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+  private:
+    static size_t words_needed(uint64_t n, uint64_t low_bits,
+                               uint64_t high_len, size_t &low_words,
+                               size_t &high_words, size_t &one_samples,
+                               size_t &zero_samples);
+    static size_t select_in_word(uint64_t w, size_t r);
+    bool check_high_bits() const;
+    void set_pointers(size_t low_words, size_t high_words,
+                      size_t one_samples);
+    uint64_t low_of(size_t i) const;
+    size_t select1(size_t i) const;
+    size_t select0(size_t i) const;
+    size_t search(uint64_t value, bool &equal) const;
+
+    std::vector<uint64_t> owned;
+    const uint64_t *words;
+    size_t n_words;
+    uint64_t n;
+    uint64_t low_bits;
+    uint64_t high_len;
+    const uint64_t *low;
+    const uint64_t *high;
+    const uint64_t *ones;
+    const uint64_t *zeros;
+};
+
+#endif
@@ -0,0 +1,261 @@
+#include "file_store.hpp"
+
+file_reader::file_reader(file_store &store) : store(store) {
+  async = ring.init(QUEUE_DEPTH);
+}
+
+posting_list file_reader::find(uint32_t key) {
+  uint64_t offset;
+  uint32_t size;
+  if (!store.lookup(key, offset, size) || size == 0) {
+    return {nullptr, 0};
+  }
+  buffer.resize(size);
+  ++store.n_sync_reads;
+  if (!read_list(buffer.data(), size, offset)) {
+    return {nullptr, 0};
+  }
+  return {buffer.data(), size};
+}
+
+void file_reader::find_batch(
+    const uint32_t *keys, size_t n,
+    const std::function<void(size_t, posting_list)> &fn) {
+  ++store.n_batches;
+
+  // locate every list and give each its own part of the buffer
+  requests.clear();
+  size_t total = 0;
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t offset;
+    uint32_t size;
+    if (!store.lookup(keys[i], offset, size) || size == 0) {
+      fn(i, {nullptr, 0});
+      continue;
+    }
+    requests.push_back({i, offset, size, total});
+    total += size;
+  }
+  buffer.resize(total);
+  std::vector<bool> done(requests.size(), false);
+
+  if (!async) {
+    finish_sync(done, fn);
+    return;
+  }
+
+  // keep the queue full and hand out lists as they complete
+  size_t next = 0;
+  size_t completed = 0;
+  while (completed < requests.size()) {
+    while (next < requests.size()) {
+      const request &r = requests[next];
+      if (!ring.prep_read(store.fd, buffer.data() + r.buf_offset,
+                          r.size * sizeof(fp_data_t),
+                          store.header.postings_offset +
+                              r.offset * sizeof(fp_data_t),
+                          next)) {
+        break;
+      }
+      ++next;
+    }
+
+    // reads still in flight may land after this, so the buffer is kept
+    // aside and the reader stays on pread from now on
+    if (ring.submit_and_wait(1) < 0) {
+      std::cerr << "io_uring failed, falling back to pread" << std::endl;
+      async = false;
+      finish_sync(done, fn);
+      retired.push_back(std::move(buffer));
+      return;
+    }
+
+    uint64_t idx;
+    int res;
+    while (ring.pop(idx, res)) {
+      const request &r = requests[idx];
+      size_t bytes = r.size * sizeof(fp_data_t);
+      fp_data_t *buf = buffer.data() + r.buf_offset;
+      ++store.n_async_reads;
+
+      // short or failed reads are completed synchronously
+      bool ok = static_cast<size_t>(res) == bytes ||
+                (res >= 0 && read_list(buf, r.size, r.offset, res)) ||
+                (res < 0 && read_list(buf, r.size, r.offset));
+      fn(r.index, ok ? posting_list{buf, r.size} : posting_list{nullptr, 0});
+      done[idx] = true;
+      ++completed;
+    }
+  }
+}
+
+// pread the part of a list after its first done_bytes bytes
+bool file_reader::read_list(fp_data_t *buf, uint32_t size, uint64_t offset,
+                            size_t done_bytes) {
+  size_t bytes = size * sizeof(fp_data_t);
+  uint64_t pos = store.header.postings_offset + offset * sizeof(fp_data_t);
+  auto dst = reinterpret_cast<char *>(buf);
+  while (done_bytes < bytes) {
+    ssize_t n = pread(store.fd, dst + done_bytes, bytes - done_bytes,
+                      pos + done_bytes);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done_bytes += n;
+  }
+  return true;
+}
+
+// read the requests that are not done yet one after another
+void file_reader::finish_sync(
+    const std::vector<bool> &done,
+    const std::function<void(size_t, posting_list)> &fn) {
+  for (size_t i = 0; i < requests.size(); ++i) {
+    if (done[i]) {
+      continue;
+    }
+    const request &r = requests[i];
+    fp_data_t *buf = buffer.data() + r.buf_offset;
+    ++store.n_sync_reads;
+    bool ok = read_list(buf, r.size, r.offset);
+    fn(r.index, ok ? posting_list{buf, r.size} : posting_list{nullptr, 0});
+  }
+}
+
+file_store::file_store()
+    : fd(-1), n_batches(0), n_async_reads(0), n_sync_reads(0) {
+  std::memset(&header, 0, sizeof(header));
+}
+
+file_store::~file_store() { close(); }
+
+bool file_store::open(const std::string &path, bool verify) {
+  close();
+
+  fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      !snapshot::check_header(header, st.st_size) ||
+      (verify && !verify_checksum())) {
+    close();
+    return false;
+  }
+
+  // only the song table and the key directory are kept in RAM
+  std::vector<uint8_t> song_bytes(header.stop_keys_offset -
+                                  header.songs_offset);
+  std::vector<uint64_t> words((header.postings_offset - header.keys_offset) /
+                              sizeof(uint64_t));
+  size_t words_bytes = words.size() * sizeof(uint64_t);
+  if (pread(fd, song_bytes.data(), song_bytes.size(), header.songs_offset) !=
+          static_cast<ssize_t>(song_bytes.size()) ||
+      pread(fd, words.data(), words_bytes, header.keys_offset) !=
+          static_cast<ssize_t>(words_bytes)) {
+    close();
+    return false;
+  }
+
+  // a version 1 key table is encoded on the way in
+  bool ok;
+  if (header.version == SNAPSHOT_TABLE_VERSION) {
+    ok = header.num_keys * sizeof(snapshot_key) <= words_bytes &&
+         directory.build(reinterpret_cast<const snapshot_key *>(words.data()),
+                         header.num_keys, header.num_postings);
+  } else {
+    ok = directory.read(std::move(words), header.num_postings);
+  }
+  if (!ok || directory.size() != header.num_keys) {
+    close();
+    return false;
+  }
+  if (!snapshot::decode_songs(song_bytes.data(), song_bytes.size(),
+                              header.num_songs, songs)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool file_store::lookup(uint32_t key, uint64_t &offset,
+                        uint32_t &size) const {
+  return directory.find(key, offset, size);
+}
+
+std::unique_ptr<posting_reader> file_store::reader() {
+  return std::unique_ptr<posting_reader>(new file_reader(*this));
+}
+
+bool file_store::scan_keys(const std::function<void(uint32_t)> &fn) const {
+  directory.scan([&fn](uint32_t key, uint64_t, uint32_t) { fn(key); });
+  return true;
+}
+
+// read the file into the page cache in order, the posting reads that
+// follow are then served from memory
+bool file_store::warm_up(const warm_progress &progress) const {
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    return false;
+  }
+  uint64_t total = st.st_size;
+  for (uint64_t done = 0; done < total;) {
+    uint64_t n = std::min<uint64_t>(WARM_CHUNK, total - done);
+    readahead(fd, done, n);
+    done += n;
+    progress(done, total);
+  }
+  return true;
+}
+
+std::string file_store::get_song(std::array<unsigned char, 16> key) const {
+  auto it = songs.find(key);
+  return it == songs.end() ? "" : it->second;
+}
+
+std::string file_store::name() const { return "file"; }
+
+size_t file_store::memory_bytes() const {
+  return directory.memory_bytes();
+}
+
+std::string file_store::stats() const {
+  return std::to_string(n_async_reads) + " reads through io_uring, " +
+         std::to_string(n_sync_reads) + " through pread in " +
+         std::to_string(n_batches) + " batches";
+}
+
+size_t file_store::num_keys() const { return directory.size(); }
+
+size_t file_store::num_postings() const { return header.num_postings; }
+
+// hash the file in WARM_CHUNK reads and compare with the header
+bool file_store::verify_checksum() const {
+  snapshot_hasher hasher;
+  snapshot::hash_header(header, hasher);
+  std::vector<uint8_t> chunk(WARM_CHUNK);
+  for (uint64_t pos = header.header_bytes; pos < header.file_bytes;) {
+    size_t n = std::min<uint64_t>(chunk.size(), header.file_bytes - pos);
+    if (pread(fd, chunk.data(), n, pos) != static_cast<ssize_t>(n)) {
+      return false;
+    }
+    hasher.update(chunk.data(), n);
+    pos += n;
+  }
+  return hasher.digest() == header.checksum;
+}
+
+void file_store::close() {
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  fd = -1;
+  directory.clear();
+  songs.clear();
+}
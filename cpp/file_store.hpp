@@ -0,0 +1,93 @@
+#ifndef _FILE_STORE_H
+#define _FILE_STORE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "io_ring.hpp"
+#include "posting_store.hpp"
+#include "snapshot.hpp"
+#include "types.hpp"
+
+class file_store;
+
+// reader with its own io_uring queue and read buffer
+class file_reader : public posting_reader {
+  public:
+    file_reader(file_store &store);
+    posting_list find(uint32_t key) override;
+    void find_batch(const uint32_t *keys, size_t n,
+                    const std::function<void(size_t, posting_list)> &fn)
+        override;
+
+    static constexpr unsigned QUEUE_DEPTH = 256;
+
+  private:
+    struct request {
+      size_t index;
+      uint64_t offset;
+      uint32_t size;
+      size_t buf_offset;
+    };
+
+    bool read_list(fp_data_t *buf, uint32_t size, uint64_t offset,
+                   size_t done_bytes = 0);
+    void finish_sync(const std::vector<bool> &done,
+                     const std::function<void(size_t, posting_list)> &fn);
+
+    file_store &store;
+    io_ring ring;
+    bool async;
+    std::vector<request> requests;
+    std::vector<fp_data_t> buffer;
+    std::vector<std::vector<fp_data_t>> retired;
+};
+
+// snapshot left on disk with only its key directory in RAM. posting lists
+// are read on demand, and all reads of a batch are in flight at once, so a
+// cold batch costs about one I/O round trip instead of one per key. with
+// verify the whole file is read once to check its checksum on opening
+class file_store : public posting_store {
+  public:
+    file_store();
+    ~file_store();
+    bool open(const std::string &path, bool verify = false);
+    bool lookup(uint32_t key, uint64_t &offset, uint32_t &size) const;
+    std::unique_ptr<posting_reader> reader() override;
+    bool scan_keys(const std::function<void(uint32_t)> &fn) const override;
+    bool warm_up(const warm_progress &progress) const override;
+    std::string get_song(std::array<unsigned char, 16> key) const override;
+    std::string name() const override;
+    size_t memory_bytes() const override;
+    std::string stats() const override;
+    size_t num_keys() const;
+    size_t num_postings() const;
+
+  private:
+    friend class file_reader;
+
+    bool verify_checksum() const;
+    void close();
+
+    int fd;
+    snapshot_header header;
+    key_directory directory;
+    std::map<std::array<unsigned char, 16>, std::string> songs;
+    std::atomic<uint64_t> n_batches;
+    std::atomic<uint64_t> n_async_reads;
+    std::atomic<uint64_t> n_sync_reads;
+};
+
+#endif
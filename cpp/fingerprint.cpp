@@ -1,19 +1,23 @@
 #include "fingerprint.hpp"
 
-// calculate fingerprint for the current buffer
+// calculate fingerprint for the current buffer, and the margins of each
+// fingerprint's bits if asked for
 std::vector<fp_t>
-fingerprint::get_fingerprints(const std::vector<double> &buffer) {
+fingerprint::get_fingerprints(const std::vector<double> &buffer,
+                              std::vector<bit_margins> *margins) {
   kfr::univector<kfr::f64> kfr_buffer(buffer.begin(), buffer.end());
 
-  return get_fingerprints(kfr_buffer);
+  return get_fingerprints(kfr_buffer, margins);
 }
 
-// calculate fingerprint for the current buffer
+// calculate fingerprint for the current buffer, and the margins of each
+// fingerprint's bits if asked for
 std::vector<fp_t>
-fingerprint::get_fingerprints(const kfr::univector<kfr::f64> &buffer) {
+fingerprint::get_fingerprints(const kfr::univector<kfr::f64> &buffer,
+                              std::vector<bit_margins> *margins) {
   auto stft = calc_stft(buffer);
   auto mels = calc_mels(stft);
-  auto fingerprints = calc_fingerprints(mels);
+  auto fingerprints = calc_fingerprints(mels, margins);
   return fingerprints;
 }
 // calculate the spectrogram
@@ -95,9 +99,13 @@ fingerprint::calc_mels(const std::vector<kfr::univector<kfr::f64>> &stft) {
 
 // find peaks and calculate fingerprints
 std::vector<fp_t> fingerprint::calc_fingerprints(
-    const std::vector<kfr::univector<kfr::f64>> &mels) {
+    const std::vector<kfr::univector<kfr::f64>> &mels,
+    std::vector<bit_margins> *margins) {
 
   std::vector<fp_t> fingerprints;
+  if (margins) {
+    margins->clear();
+  }
 
   for (size_t t = 9; t < mels.size() - 9; ++t) {
     for (size_t b = 1; b < mels[0].size() - 1; ++b) {
@@ -266,6 +274,13 @@ std::vector<fp_t> fingerprint::calc_fingerprints(
 
       // add fingerprint to return vector
       fingerprints.emplace_back(fp, t);
+      if (margins) {
+        bit_margins m;
+        for (size_t i = 0; i < energy_diffs.size(); ++i) {
+          m[i] = std::abs(energy_diffs[i]);
+        }
+        margins->push_back(m);
+      }
     }
   }
 
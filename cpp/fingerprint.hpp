@@ -2,6 +2,7 @@
 #define _FINGERPRINT_H
 
 #include <array>
+#include <cmath>
 #include <iostream>
 #include <unordered_map>
 #include <vector>
@@ -22,9 +23,11 @@ public:
   // ~fingerprint();
 
   std::vector<fp_t>
-  get_fingerprints(const std::vector<double> &buffer);
+  get_fingerprints(const std::vector<double> &buffer,
+                   std::vector<bit_margins> *margins = nullptr);
   std::vector<fp_t>
-  get_fingerprints(const kfr::univector<kfr::f64> &buffer);
+  get_fingerprints(const kfr::univector<kfr::f64> &buffer,
+                   std::vector<bit_margins> *margins = nullptr);
 
   static constexpr int FS = 4000;
 
@@ -39,7 +42,8 @@ private:
   calc_mels(const std::vector<kfr::univector<kfr::f64>> &stft);
 
   std::vector<fp_t>
-  calc_fingerprints(const std::vector<kfr::univector<kfr::f64>> &mels);
+  calc_fingerprints(const std::vector<kfr::univector<kfr::f64>> &mels,
+                    std::vector<bit_margins> *margins);
 };
 
 #endif
@@ -0,0 +1,114 @@
+#include "hamming_index.hpp"
+
+constexpr int hamming_index::MAX_RADIUS;
+constexpr int hamming_index::MAX_TABLE_BITS;
+
+hamming_index::hamming_index() : radius(0), n_keys(0) {}
+
+// index the distinct keys among keys for searches within radius
+void hamming_index::build(std::vector<uint32_t> keys, int radius) {
+  radius = std::max(0, std::min(radius, MAX_RADIUS));
+  this->radius = radius;
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  n_keys = keys.size();
+
+  // radius + 1 substrings of the mask bits, the low ones a bit longer
+  size_t num_tables = radius + 1;
+  tables.assign(num_tables, table());
+  int shift = 0;
+  for (size_t j = 0; j < num_tables; ++j) {
+    table &t = tables[j];
+    t.shift = shift;
+    t.width = MASK_BITS / num_tables + (j < MASK_BITS % num_tables ? 1 : 0);
+    t.bits = std::min(t.width, MAX_TABLE_BITS);
+    shift += t.width;
+
+    // counting sort of the keys by band and substring
+    t.starts.assign((static_cast<size_t>(MAX_BANDS) << t.bits) + 1, 0);
+    for (uint32_t key : keys) {
+      ++t.starts[bucket_of(t, key) + 1];
+    }
+    for (size_t b = 1; b < t.starts.size(); ++b) {
+      t.starts[b] += t.starts[b - 1];
+    }
+    t.keys.resize(keys.size());
+    std::vector<uint32_t> next(t.starts.begin(), t.starts.end() - 1);
+    for (uint32_t key : keys) {
+      t.keys[next[bucket_of(t, key)]++] = key;
+    }
+  }
+}
+
+// keys within the radius of key in its band, each once. a key is only
+// taken from the first table whose whole substring it agrees on. returns
+// the number of keys compared
+size_t hamming_index::search(uint32_t key,
+                             std::vector<uint32_t> &neighbours) const {
+  const uint32_t mask_bits = (1u << MASK_BITS) - 1;
+  size_t compared = 0;
+  for (size_t j = 0; j < tables.size(); ++j) {
+    const table &t = tables[j];
+    uint32_t b = bucket_of(t, key);
+    const uint32_t *begin = t.keys.data() + t.starts[b];
+    const uint32_t *end = t.keys.data() + t.starts[b + 1];
+    compared += end - begin;
+
+    for (const uint32_t *k = begin; k != end; ++k) {
+      uint32_t diff = (*k ^ key) & mask_bits;
+      if (__builtin_popcount(diff) > radius) {
+        continue;
+      }
+      size_t first = 0;
+      while (!agrees(tables[first], diff)) {
+        ++first;
+      }
+      if (first == j) {
+        neighbours.push_back(*k);
+      }
+    }
+  }
+  return compared;
+}
+
+int hamming_index::get_radius() const { return radius; }
+
+size_t hamming_index::num_tables() const { return tables.size(); }
+
+size_t hamming_index::num_keys() const { return n_keys; }
+
+size_t hamming_index::memory_bytes() const {
+  size_t bytes = 0;
+  for (const auto &t : tables) {
+    bytes += (t.starts.capacity() + t.keys.capacity()) * sizeof(uint32_t);
+  }
+  return bytes;
+}
+
+// every key within radius of key whether stored or not, key itself first.
+// this is what probing without the index costs
+void hamming_index::enumerate(uint32_t key, int radius,
+                              std::vector<uint32_t> &variants) {
+  variants.push_back(key);
+  add_flips(key, 0, radius, variants);
+}
+
+// variants of key with up to radius more bits flipped, all above first
+void hamming_index::add_flips(uint32_t key, int first, int radius,
+                              std::vector<uint32_t> &variants) {
+  if (radius == 0) {
+    return;
+  }
+  for (int i = first; i < MASK_BITS; ++i) {
+    variants.push_back(key ^ (1u << i));
+    add_flips(key ^ (1u << i), i + 1, radius - 1, variants);
+  }
+}
+
+bool hamming_index::agrees(const table &t, uint32_t diff) {
+  return (diff >> t.shift & ((1u << t.width) - 1)) == 0;
+}
+
+uint32_t hamming_index::bucket_of(const table &t, uint32_t key) {
+  return band_of(key) << t.bits | (key >> t.shift & ((1u << t.bits) - 1));
+}
@@ -0,0 +1,54 @@
+#ifndef _HAMMING_INDEX_H
+#define _HAMMING_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "types.hpp"
+
+// multi-index hashing over the distinct keys of an index, for finding the
+// keys within hamming distance radius of a fingerprint's mask bits. the
+// mask bits are cut into radius + 1 substrings and every table groups the
+// keys by band and one substring. a key with at most radius differing bits
+// agrees with the fingerprint on at least one whole substring, so a search
+// is one exact lookup per table and a popcount over the keys found there,
+// instead of probing every one of the sum of C(MASK_BITS, k) variants.
+// substrings get shorter as the radius grows, so the buckets scanned grow
+// while the number of lookups stays radius + 1
+class hamming_index {
+  public:
+    hamming_index();
+    void build(std::vector<uint32_t> keys, int radius);
+    size_t search(uint32_t key, std::vector<uint32_t> &neighbours) const;
+    int get_radius() const;
+    size_t num_tables() const;
+    size_t num_keys() const;
+    size_t memory_bytes() const;
+    static void enumerate(uint32_t key, int radius,
+                          std::vector<uint32_t> &variants);
+
+    static constexpr int MAX_RADIUS = MASK_BITS - 1;
+    // longer substrings only index their low bits, bounding the buckets
+    static constexpr int MAX_TABLE_BITS = 16;
+
+  private:
+    struct table {
+      int shift;
+      int width;
+      int bits;
+      std::vector<uint32_t> starts;
+      std::vector<uint32_t> keys;
+    };
+
+    static uint32_t bucket_of(const table &t, uint32_t key);
+    static bool agrees(const table &t, uint32_t diff);
+    static void add_flips(uint32_t key, int first, int radius,
+                          std::vector<uint32_t> &variants);
+
+    std::vector<table> tables;
+    int radius;
+    size_t n_keys;
+};
+
+#endif
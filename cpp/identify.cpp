@@ -20,8 +20,43 @@ static int cur_idx;
 static int input_buf_n = 0;
 
 static fingerprint fp;
-static database fp_db("fingerprints.db");
-static database songs_db("songs.db");
+
+static std::mutex trace_mtx;
+static std::ofstream trace;
+
+// probes reach keys within this hamming distance, found by enumerating
+// the variants of each fingerprint or, with use_neighbours, by searching
+// a multi-index hash of the keys the store holds
+static int radius = HAMMING_RADIUS;
+static bool use_neighbours = false;
+static hamming_index neighbours;
+
+// with use_reliability the probes go out likeliest first from the bit
+// margins of each fingerprint, limited to probe_budget keys, max_cost and
+// the toggle_bits least reliable bits
+static bool use_reliability = false;
+static int toggle_bits = MASK_BITS;
+static size_t probe_budget = 0;
+static float max_cost = 0;
+
+// votes for a song also count at offsets within this many steps
+static int vote_slack = VOTE_SLACK;
+
+// probes are made and looked up on a pool of num_workers threads, one per
+// core if 0, each with a reader and votes of its own
+static size_t num_workers = 0;
+static std::unique_ptr<worker_pool> pool;
+static std::vector<worker_state> workers;
+
+// rule deciding when the votes name a song, checked every DECISION_STEP
+// fingerprints of a buffer, most informative first
+static decision_rule rule = decision_rule::threshold;
+
+// a refreshed index waiting to be swapped in, and what it replaced waiting
+// to be freed, both handed between the refresh thread and the listen loop
+static std::mutex swap_mtx;
+static std::unique_ptr<refreshed_index> refreshed;
+static std::unique_ptr<refreshed_index> retired;
 
 int audio_callback(void *outputBuffer, void *inputBuffer,
                    const unsigned int nBufferFrames, double streamTime,
@@ -99,11 +134,8 @@ void fill_double_bufs(const kfr::univector<kfr::f64> &data) {
   return;
 }
 
-void check_fingerprints() {
-  std::map<std::array<uint8_t, 16>, std::map<int, int>> hists;
-  int cur_max = 0;
-  int cur_max_t = 0;
-  std::array<uint8_t, 16> cur_max_id;
+void check_fingerprints(posting_store &store, database &songs_db) {
+  vote_table votes(vote_slack);
   int elapsed = 0;
 
   std::cout << "Listening" << std::flush;
@@ -129,48 +161,35 @@ void check_fingerprints() {
       std::copy(buf_2.begin(), buf_2.end(), process_buf.begin());
     }
 
-    // calculate fingerprints
-    auto fingerprints = fp.get_fingerprints(process_buf);
+    // calculate fingerprints, the margins of their bits tell how
+    // informative each one is
+    std::vector<bit_margins> margins;
+    auto fingerprints = fp.get_fingerprints(process_buf, &margins);
 
     // std::cerr << fingerprints.size() << std::endl;
 
-    // find matching fingerprints in database
-    auto matches = find_matches(fingerprints);
+    // pick up newly ingested or merged segments between buffers, their
+    // readers and neighbour index are ready built by the refresh thread
+    swap_refreshed();
 
     // update elapsed time
     elapsed += BUF_SIZE * 100 / fp.FS;
 
-    // compute histograms
-    std::array<uint8_t, 16> temp_id;
-    for (const auto &m : matches) {
-      int dt = m.t - elapsed;
-      std::copy(m.id, m.id + 16, temp_id.begin());
-
-      // find histogram for id
-      auto it = hists.find(temp_id);
-      if (it == hists.end()) {
-        std::map<int, int> temp_t;
-        hists[temp_id] = temp_t;
-      }
-
-      // insert delta time
-      auto it2 = hists[temp_id].find(dt);
-      if (it2 == hists[temp_id].end()) {
-        hists[temp_id][dt] = 0;
-      }
-      ++hists[temp_id][dt];
-
-      // update current max score
-      if (hists[temp_id][dt] > cur_max) {
-        cur_max = hists[temp_id][dt];
-        cur_max_t = dt;
-        std::copy(temp_id.begin(), temp_id.end(), cur_max_id.begin());
-      }
-    }
+    // find matching fingerprints in database and vote for each song at
+    // its time offset, until the votes are enough to decide
+    size_t looked_up = 0;
+    bool decided = score_buffer(fingerprints, margins, store, songs_db,
+                                elapsed, votes, looked_up);
+    int cur_max = votes.best_score();
+    int cur_max_t = votes.best_offset();
+    auto cur_max_id = votes.best_id();
 
     // show output information if match is found
-    if (cur_max >= THRESHOLD) {
-      auto result = songs_db.get_song(cur_max_id);
+    if (decided) {
+      auto result = store.get_song(cur_max_id);
+      if (result == "") {
+        result = songs_db.get_song(cur_max_id);
+      }
       int elapsed_time = (elapsed + cur_max_t) * 10 / 1000;
       int elapsed_min = elapsed_time / 60;
       int elapsed_sec = elapsed_time % 60;
@@ -179,6 +198,17 @@ void check_fingerprints() {
       printf("result:       %s\n", result.c_str());
       printf("score:        %d\n", cur_max);
       printf("elapsed time: %02d:%02d\n", elapsed_min, elapsed_sec);
+      printf("listened:     %.1f s, %zu/%zu fingerprints of the last "
+             "buffer\n",
+             elapsed * 10 / 1000.0, looked_up, fingerprints.size());
+
+      // check the whole buffer against the song at the matched offset
+      int verified = 0;
+      if (verify_match(songs_db, cur_max_id, fingerprints,
+                       elapsed + cur_max_t, verified)) {
+        printf("verified:     %d/%zu fingerprints\n", verified,
+               fingerprints.size());
+      }
       return;
     }
 
@@ -198,35 +228,619 @@ void check_fingerprints() {
   }
 }
 
-std::vector<fp_data_t> find_matches(const std::vector<fp_t> &fingerprints) {
-  std::vector<fp_data_t> all_matches;
-  int num_matches = 0;
-  for (fp_t f : fingerprints) {
-    uint32_t fp = f.fp;
-    for (int idx_1 = -1; idx_1 < 22; ++idx_1) {
-      for (int idx_2 = -1; idx_2 < idx_1; ++idx_2) {
-
-        uint32_t temp_fp = fp;
-        if (idx_1 != -1) {
-          temp_fp ^= 1 << idx_1;
-        }
-        if (idx_2 != -1) {
-          temp_fp ^= 1 << idx_2;
-        }
+// look up the fingerprints of a buffer DECISION_STEP at a time, the most
+// informative first, and stop as soon as the votes decide. looked_up is
+// set to the number of fingerprints looked up. the margins order the
+// fingerprints and are passed on to find_matches with use_reliability
+bool score_buffer(const std::vector<fp_t> &fingerprints,
+                  const std::vector<bit_margins> &margins,
+                  posting_store &store, const database &songs_db,
+                  int elapsed, vote_table &votes, size_t &looked_up) {
+  std::vector<size_t> order(fingerprints.size());
+  std::iota(order.begin(), order.end(), 0);
+  if (margins.size() == fingerprints.size()) {
+    std::vector<float> information(fingerprints.size());
+    for (size_t i = 0; i < fingerprints.size(); ++i) {
+      information[i] = information_of(margins[i]);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&information](size_t a, size_t b) {
+                       return information[a] > information[b];
+                     });
+  }
+
+  std::vector<fp_t> step;
+  std::vector<bit_margins> step_margins;
+  looked_up = 0;
+  while (looked_up < order.size()) {
+    size_t end = std::min(order.size(), looked_up + DECISION_STEP);
+    step.clear();
+    step_margins.clear();
+    for (size_t i = looked_up; i < end; ++i) {
+      step.push_back(fingerprints[order[i]]);
+      if (use_reliability) {
+        step_margins.push_back(margins[order[i]]);
+      }
+    }
+    find_matches(step, step_margins, store, songs_db, elapsed, votes);
+    looked_up = end;
+    if (decide(votes, elapsed, rule)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// a fingerprint survives noise flipping up to radius of its bits when all
+// of them are within reach of the probes, so the margin of the bit that
+// would be the radius + 1-th to flip tells how likely its key is found
+float information_of(const bit_margins &margins) {
+  bit_margins sorted = margins;
+  int k = std::min(radius, MASK_BITS - 1);
+  std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+  return sorted[k];
+}
+
+// look up the probes of every fingerprint on the worker pool and vote for
+// each match at its time offset from elapsed. workers first make the
+// one worker per core unless num_workers is set, once per run
+void start_workers() {
+  if (pool) {
+    return;
+  }
+  size_t n = num_workers > 0
+                 ? num_workers
+                 : std::max(std::thread::hardware_concurrency(), 1u);
+  pool.reset(new worker_pool(n));
+  for (size_t w = 0; w < n; ++w) {
+    workers.emplace_back(vote_slack);
+  }
+}
 
-        auto matches = fp_db.get_fp(temp_fp);
-        for (auto &m : matches) {
-          m.t -= f.t;
+// probes of a share of the fingerprints, grouped by store partition, then
+// look up one worker's probes of one partition at a time, voting into
+// tables of their own that are added into votes at the end. margins may
+// be empty, or hold those of each fingerprint
+void find_matches(const std::vector<fp_t> &fingerprints,
+                  const std::vector<bit_margins> &margins,
+                  posting_store &store, const database &songs_db,
+                  int elapsed, vote_table &votes) {
+  start_workers();
+  for (auto &w : workers) {
+    w.probes.resize(store.num_partitions());
+    for (auto &p : w.probes) {
+      p.clear();
+    }
+  }
+
+  // a short step of score_buffer is still spread over every worker
+  size_t chunk_size = std::max<size_t>(
+      1, std::min(PROBE_CHUNK,
+                  (fingerprints.size() + pool->size() - 1) / pool->size()));
+  size_t num_chunks = (fingerprints.size() + chunk_size - 1) / chunk_size;
+  pool->run(num_chunks, [&](size_t w, size_t chunk) {
+    std::vector<fp_t> fp_probes;
+    size_t end = std::min(fingerprints.size(), (chunk + 1) * chunk_size);
+    for (size_t i = chunk * chunk_size; i < end; ++i) {
+      fp_probes.clear();
+      add_probes(fingerprints[i], margins.empty() ? nullptr : &margins[i],
+                 fp_probes);
+      for (const auto &p : fp_probes) {
+        workers[w].probes[store.partition_of(p.fp)].push_back(p);
+      }
+
+      // record probed keys for replay by mask_bench
+      if (trace.is_open()) {
+        std::lock_guard<std::mutex> lck(trace_mtx);
+        for (const auto &p : fp_probes) {
+          trace.write(reinterpret_cast<const char *>(&p.fp), sizeof(p.fp));
         }
-        all_matches.insert(all_matches.end(), matches.begin(), matches.end());
-        num_matches += matches.size();
+      }
+    }
+  });
+
+  // each group of probes goes out as one batch, so stores reading from
+  // disk can have them in flight together
+  std::vector<std::pair<size_t, size_t>> groups;
+  for (size_t s = 0; s < store.num_partitions(); ++s) {
+    for (size_t v = 0; v < workers.size(); ++v) {
+      if (!workers[v].probes[s].empty()) {
+        groups.emplace_back(v, s);
       }
     }
   }
-  return all_matches;
+  pool->run(groups.size(), [&](size_t w, size_t g) {
+    const auto &probes = workers[groups[g].first].probes[groups[g].second];
+    std::vector<uint32_t> keys;
+    keys.reserve(probes.size());
+    for (const auto &p : probes) {
+      keys.push_back(p.fp);
+    }
+
+    worker_state &state = workers[w];
+    if (!state.reader) {
+      state.reader = store.reader();
+    }
+    state.reader->find_batch(
+        keys.data(), keys.size(), [&](size_t idx, posting_list list) {
+          int32_t t = probes[idx].t + elapsed;
+          for (size_t i = 0; i < list.size; ++i) {
+            // postings of deleted songs stay in the index until
+            // compaction
+            if (!songs_db.is_deleted(list.data[i].id)) {
+              state.votes.add(list.data[i].id, list.data[i].t - t);
+            }
+          }
+        });
+  });
+
+  for (auto &w : workers) {
+    votes.absorb(w.votes);
+  }
 }
 
-int main() {
+// check the store for a new version every REFRESH_MS until done. mapping
+// it, making its readers and indexing its keys can take long on a large
+// catalogue, so it all happens here and never holds up the listen loop
+void refresh_index(posting_store &store) {
+  std::unique_lock<std::mutex> lck(done_mtx);
+  while (!done_cv.wait_for(lck, std::chrono::milliseconds(REFRESH_MS),
+                           [] { return done.load(); })) {
+    lck.unlock();
+
+    // free what the last swap replaced
+    std::unique_ptr<refreshed_index> old;
+    {
+      std::lock_guard<std::mutex> swap_lck(swap_mtx);
+      old.swap(retired);
+    }
+    old.reset();
+
+    if (store.refresh()) {
+      std::unique_ptr<refreshed_index> next(new refreshed_index());
+      for (size_t w = 0; w < workers.size(); ++w) {
+        next->readers.push_back(store.reader());
+      }
+      if (use_neighbours) {
+        index_neighbours(store, next->neighbours);
+      }
+      std::lock_guard<std::mutex> swap_lck(swap_mtx);
+      refreshed.swap(next);
+    }
+    lck.lock();
+  }
+}
+
+// swap in the readers and neighbour index of a refreshed index if one is
+// ready. readers made before keep seeing the old index until then. a swap
+// waits until the refresh thread has freed what the last one replaced
+bool swap_refreshed() {
+  std::lock_guard<std::mutex> lck(swap_mtx);
+  if (!refreshed || retired) {
+    return false;
+  }
+  for (size_t w = 0; w < workers.size() && w < refreshed->readers.size();
+       ++w) {
+    std::swap(workers[w].reader, refreshed->readers[w]);
+  }
+  if (use_neighbours) {
+    std::swap(neighbours, refreshed->neighbours);
+  }
+  retired.swap(refreshed);
+  return true;
+}
+
+// count the fingerprints of the buffer that the song has within
+// VERIFY_SLACK of their time shifted by offset, using the song's forward
+// index instead of probing. false if the song has no forward index
+bool verify_match(database &songs_db, const std::array<uint8_t, 16> &id,
+                  const std::vector<fp_t> &fingerprints, int offset,
+                  int &verified) {
+  verified = 0;
+  if (fingerprints.empty()) {
+    return false;
+  }
+
+  auto range = std::minmax_element(
+      fingerprints.begin(), fingerprints.end(),
+      [](const fp_t &a, const fp_t &b) { return a.t < b.t; });
+  std::vector<fp_t> window;
+  if (!songs_db.get_forward(id, range.first->t + offset - VERIFY_SLACK,
+                            range.second->t + offset + VERIFY_SLACK + 1,
+                            window)) {
+    return false;
+  }
+
+  std::unordered_multimap<uint32_t, int32_t> song_fps;
+  for (const auto &f : window) {
+    song_fps.emplace(f.fp, f.t);
+  }
+  for (const auto &f : fingerprints) {
+    auto hits = song_fps.equal_range(f.fp);
+    for (auto it = hits.first; it != hits.second; ++it) {
+      if (std::abs(it->second - (f.t + offset)) <= VERIFY_SLACK) {
+        ++verified;
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+// index the keys of the store for neighbour searches within radius
+bool index_neighbours(const posting_store &store, hamming_index &index) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<uint32_t> keys;
+  if (!store.scan_keys([&keys](uint32_t key) { keys.push_back(key); })) {
+    return false;
+  }
+  index.build(std::move(keys), radius);
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cerr << "Indexed " << index.num_keys() << " keys in "
+            << index.num_tables() << " tables ("
+            << index.memory_bytes() / (1024 * 1024) << " MiB) in "
+            << elapsed.count() << " s" << std::endl;
+  return true;
+}
+
+// keys within hamming distance radius of the fingerprint's mask bits,
+// every variant, only those that are stored with the neighbour index, or
+// the likeliest ones first given the margins of the fingerprint's bits
+void add_probes(const fp_t &f, const bit_margins *margins,
+                std::vector<fp_t> &probes) {
+  static thread_local std::vector<uint32_t> keys;
+  static thread_local probe_generator generator(radius, toggle_bits,
+                                                probe_budget, max_cost);
+  keys.clear();
+  if (use_neighbours) {
+    neighbours.search(f.fp, keys);
+  } else if (margins) {
+    generator.generate(f.fp, *margins, keys);
+  } else {
+    hamming_index::enumerate(f.fp, radius, keys);
+  }
+  for (uint32_t key : keys) {
+    probes.emplace_back(key, f.t);
+  }
+}
+
+// percentage of a warm-up, rewritten in place as it changes
+void report_progress(const char *what, uint64_t done, uint64_t total) {
+  static int last = -1;
+  int percent = total == 0 ? 100 : static_cast<int>(100 * done / total);
+  if (percent != last) {
+    std::cerr << "\r" << what << " " << percent << "%" << std::flush;
+    last = percent;
+  }
+  if (done >= total) {
+    std::cerr << std::endl;
+    last = -1;
+  }
+}
+
+// read the whole index into memory in order before the first lookup
+bool warm_index(const posting_store &store) {
+  auto start = std::chrono::steady_clock::now();
+  uint64_t bytes = 0;
+  if (!store.warm_up([&bytes](uint64_t done, uint64_t total) {
+        bytes = total;
+        report_progress("Warming index", done, total);
+      })) {
+    return false;
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cerr << "Warmed " << bytes / (1024 * 1024) << " MiB in "
+            << elapsed.count() << " s" << std::endl;
+  return true;
+}
+
+// look up the WARM_KEYS keys probed most often in a trace written by an
+// earlier run, in key order so neighbouring keys share their reads. this
+// brings in only the hot part of an index too large to warm whole
+bool warm_keys(posting_store &store, const std::string &trace_path) {
+  std::ifstream f(trace_path, std::ios::binary);
+  if (!f) {
+    return false;
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::unordered_map<uint32_t, uint32_t> counts;
+  uint32_t key;
+  while (f.read(reinterpret_cast<char *>(&key), sizeof(key))) {
+    ++counts[key];
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> hot(counts.begin(),
+                                                 counts.end());
+  if (hot.size() > WARM_KEYS) {
+    std::nth_element(hot.begin(), hot.begin() + WARM_KEYS, hot.end(),
+                     [](const std::pair<uint32_t, uint32_t> &a,
+                        const std::pair<uint32_t, uint32_t> &b) {
+                       return a.second > b.second;
+                     });
+    hot.resize(WARM_KEYS);
+  }
+  std::vector<uint32_t> keys;
+  for (const auto &h : hot) {
+    keys.push_back(h.first);
+  }
+  std::sort(keys.begin(), keys.end());
+
+  // touch every posting, mapped stores only fault in what is read
+  auto reader = store.reader();
+  uint64_t postings = 0;
+  uint32_t sum = 0;
+  for (size_t i = 0; i < keys.size(); i += WARM_BATCH) {
+    size_t n = std::min(WARM_BATCH, keys.size() - i);
+    reader->find_batch(keys.data() + i, n,
+                       [&postings, &sum](size_t, posting_list list) {
+                         postings += list.size;
+                         for (size_t j = 0; j < list.size; ++j) {
+                           sum += list.data[j].t;
+                         }
+                       });
+    report_progress("Warming hot keys", i + n, keys.size());
+  }
+  volatile uint32_t touched = sum;
+  static_cast<void>(touched);
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cerr << "Warmed " << keys.size() << " hot keys, " << postings
+            << " postings in " << elapsed.count() << " s" << std::endl;
+  return true;
+}
+
+int main(int argc, char **argv) {
+  // parse options
+  bool use_ram = false;
+  std::string snapshot_path;
+  std::string mmap_path;
+  std::string file_path;
+  std::string segment_dir;
+  size_t tier_bytes = 0;
+  placement where;
+  bool verify = false;
+  bool warm = false;
+  std::string warm_path;
+  std::string trace_path;
+  int opt;
+  while ((opt = getopt(argc, argv, "rs:m:f:cg:T:H:N:t:R:MP:L:K:V:j:d:wW:")) != -1) {
+    switch (opt) {
+    case 'r':
+      use_ram = true;
+      break;
+    case 's':
+      snapshot_path = optarg;
+      break;
+    case 'm':
+      mmap_path = optarg;
+      break;
+    case 'f':
+      file_path = optarg;
+      break;
+    case 'c':
+      verify = true;
+      break;
+    case 'g':
+      segment_dir = optarg;
+      break;
+    case 'T':
+      tier_bytes = std::stoul(optarg) * 1024 * 1024;
+      break;
+    case 'H':
+      if (!page_region::parse_mode(optarg, where.pages)) {
+        std::cerr << "Error: unknown page mode " << optarg << std::endl;
+        return 1;
+      }
+      break;
+    case 'N':
+      if (!memory_index::parse_numa_mode(optarg, where.numa)) {
+        std::cerr << "Error: unknown numa mode " << optarg << std::endl;
+        return 1;
+      }
+      break;
+    case 't':
+      trace_path = optarg;
+      break;
+    case 'R':
+      radius = std::stoi(optarg);
+      if (radius < 0 || radius > hamming_index::MAX_RADIUS) {
+        std::cerr << "Error: radius must be 0 to "
+                  << hamming_index::MAX_RADIUS << std::endl;
+        return 1;
+      }
+      break;
+    case 'M':
+      use_neighbours = true;
+      break;
+    case 'P':
+      probe_budget = std::stoul(optarg);
+      use_reliability = true;
+      break;
+    case 'L':
+      max_cost = std::stof(optarg);
+      use_reliability = true;
+      break;
+    case 'K':
+      toggle_bits = std::stoi(optarg);
+      if (toggle_bits < 0 || toggle_bits > MASK_BITS) {
+        std::cerr << "Error: toggle bits must be 0 to " << MASK_BITS
+                  << std::endl;
+        return 1;
+      }
+      use_reliability = true;
+      break;
+    case 'V':
+      vote_slack = std::stoi(optarg);
+      if (vote_slack < 0) {
+        std::cerr << "Error: vote slack must not be negative" << std::endl;
+        return 1;
+      }
+      break;
+    case 'j':
+      num_workers = std::stoul(optarg);
+      break;
+    case 'd':
+      if (!parse_rule(optarg, rule)) {
+        std::cerr << "Error: unknown decision rule " << optarg << std::endl;
+        return 1;
+      }
+      break;
+    case 'w':
+      warm = true;
+      break;
+    case 'W':
+      warm_path = optarg;
+      break;
+    default:
+      std::cout << "Usage: " << argv[0]
+                << " [-r] [-s snapshot] [-m snapshot] [-f snapshot] [-c] "
+                   "[-g segment_dir] [-T ram_mib] [-H pages] [-N numa] "
+                   "[-t trace] [-R radius] [-M] [-P probes] [-L cost] "
+                   "[-K bits] [-V slack] [-j workers] [-d rule] [-w] [-W trace]"
+                << std::endl;
+      std::cout << "  -r  load the whole index into RAM before listening"
+                << std::endl;
+      std::cout << "  -s  load the index and song names from a snapshot"
+                << std::endl;
+      std::cout << "  -m  map a snapshot read-only instead of loading it, "
+                   "shared with other processes and remapped when replaced"
+                << std::endl;
+      std::cout << "  -f  leave a snapshot on disk and read postings with "
+                   "batched async I/O"
+                << std::endl;
+      std::cout << "  -c  check the checksum of a -m or -f snapshot before "
+                   "listening, and of every snapshot -m swaps in"
+                << std::endl;
+      std::cout << "  -g  read a segmented index that ingest may add to"
+                << std::endl;
+      std::cout << "  -T  keep the most probed keys in ram_mib of RAM"
+                << std::endl;
+      std::cout << "  -H  normal, thp or hugetlb pages for -r and -s"
+                << std::endl;
+      std::cout << "  -N  none, interleave or replicate over NUMA nodes for "
+                   "-r and -s"
+                << std::endl;
+      std::cout << "  -t  record every probed key to a trace file"
+                << std::endl;
+      std::cout << "  -R  probe keys within this hamming distance, default "
+                << HAMMING_RADIUS << std::endl;
+      std::cout << "  -M  find those keys with a multi-index hash of the "
+                   "stored keys instead of probing every variant"
+                << std::endl;
+      std::cout << "  -P  probe at most this many keys per fingerprint, "
+                   "likeliest first by the margins of its bits"
+                << std::endl;
+      std::cout << "  -L  skip probes whose flipped bits have margins "
+                   "summing to more than this many mean margins"
+                << std::endl;
+      std::cout << "  -K  only flip this many least reliable bits, "
+                   "default all "
+                << MASK_BITS << std::endl;
+      std::cout << "  -V  score offsets with the votes within this many "
+                   "steps, default "
+                << VOTE_SLACK << std::endl;
+      std::cout << "  -j  look up probes on this many threads, default one "
+                   "per core"
+                << std::endl;
+      std::cout << "  -d  name the song by threshold, rate or likelihood "
+                   "of the votes, default threshold"
+                << std::endl;
+      std::cout << "  -w  read the whole index into the page cache before "
+                   "listening"
+                << std::endl;
+      std::cout << "  -W  before listening, look up the keys probed most "
+                   "often in a trace from -t"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  if (use_neighbours && use_reliability) {
+    std::cerr << "Error: -M cannot be combined with -P, -L or -K"
+              << std::endl;
+    return 1;
+  }
+
+  // pick the index backend
+  std::unique_ptr<posting_store> store;
+  if (use_ram || snapshot_path != "") {
+    memory_index *index = new memory_index();
+    store.reset(index);
+    if (snapshot_path == "") {
+      sharded_database fp_db("fingerprints.db");
+      index->load(fp_db);
+    } else if (!index->load(snapshot_path)) {
+      std::cerr << "Error: bad snapshot " << snapshot_path << std::endl;
+      return 1;
+    }
+    if (!index->place(where)) {
+      std::cerr << "Error: could not place index in memory" << std::endl;
+      return 1;
+    }
+    std::cerr << "Loaded " << index->num_keys() << " keys, "
+              << index->num_postings() << " postings ("
+              << index->memory_bytes() / (1024 * 1024) << " MiB) in "
+              << index->load_seconds() << " s, "
+              << index->placement_info() << std::endl;
+  } else if (mmap_path != "") {
+    shared_index *mapped = new shared_index();
+    store.reset(mapped);
+    if (!mapped->open(mmap_path, verify)) {
+      std::cerr << "Error: bad snapshot " << mmap_path << std::endl;
+      return 1;
+    }
+    std::cerr << "Mapped " << mapped->num_keys() << " keys, "
+              << mapped->num_postings() << " postings ("
+              << mapped->memory_bytes() / (1024 * 1024) << " MiB)"
+              << std::endl;
+  } else if (file_path != "") {
+    file_store *file = new file_store();
+    store.reset(file);
+    if (!file->open(file_path, verify)) {
+      std::cerr << "Error: bad snapshot " << file_path << std::endl;
+      return 1;
+    }
+    std::cerr << "Opened " << file->num_keys() << " keys, "
+              << file->num_postings() << " postings on disk" << std::endl;
+  } else if (segment_dir != "") {
+    segment_store *segments = new segment_store();
+    store.reset(segments);
+    if (!segments->open(segment_dir)) {
+      std::cerr << "Error: no segments in " << segment_dir << std::endl;
+      return 1;
+    }
+    std::cerr << "Mapped " << segments->num_segments() << " segments ("
+              << segments->memory_bytes() / (1024 * 1024) << " MiB)"
+              << std::endl;
+  } else if (tier_bytes > 0) {
+    store.reset(new tiered_store("fingerprints.db", tier_bytes));
+  } else {
+    store.reset(new unqlite_store("fingerprints.db", CACHE_BYTES));
+  }
+
+  if (use_neighbours && !index_neighbours(*store, neighbours)) {
+    std::cerr << "Error: " << store->name() << " index cannot list its keys"
+              << std::endl;
+    return 1;
+  }
+
+  // warm up before the first lookup, the trace of the last run is read
+  // before this run's trace may replace it
+  if (warm && !warm_index(*store)) {
+    std::cerr << store->name() << " index is already in memory" << std::endl;
+  }
+  if (warm_path != "" && !warm_keys(*store, warm_path)) {
+    std::cerr << "No trace at " << warm_path << ", hot keys not warmed"
+              << std::endl;
+  }
+  if (trace_path != "") {
+    trace.open(trace_path, std::ios::binary | std::ios::trunc);
+  }
+
   RtAudio adc;
   if (adc.getDeviceCount() < 1) {
     std::cout << "\nNo audio devices found!\n";
@@ -246,11 +860,26 @@ int main() {
     e.printMessage();
     exit(0);
   }
+  std::cerr << "Ready" << std::endl;
 
-  std::thread fp_listener(check_fingerprints);
+  database songs_db("songs.db");
+  start_workers();
+  std::thread refresher(refresh_index, std::ref(*store));
+  std::thread fp_listener(check_fingerprints, std::ref(*store),
+                          std::ref(songs_db));
 
   // wait for song to be identified
   fp_listener.join();
+  {
+    std::lock_guard<std::mutex> lck(done_mtx);
+    done = true;
+  }
+  done_cv.notify_all();
+  refresher.join();
+
+  if (store->stats() != "") {
+    std::cerr << store->stats() << std::endl;
+  }
 
   try {
     // Stop the stream
@@ -7,34 +7,106 @@
 #include <chrono>
 #include <condition_variable>
 #include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <mutex>
 #include <map>
+#include <memory>
+#include <numeric>
+#include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
+#include <unistd.h>
 
 #include "database.hpp"
+#include "decision.hpp"
+#include "file_store.hpp"
 #include "fingerprint.hpp"
+#include "hamming_index.hpp"
+#include "memory_index.hpp"
+#include "mmap_store.hpp"
+#include "posting_store.hpp"
+#include "probe_generator.hpp"
+#include "segment_store.hpp"
+#include "shared_index.hpp"
+#include "sharded_database.hpp"
+#include "tiered_store.hpp"
+#include "unqlite_store.hpp"
+#include "vote_table.hpp"
+#include "worker_pool.hpp"
 #include "RtAudio.h"
 #include "kfr/base.hpp"
 #include "kfr/dft.hpp"
 #include "kfr/dsp.hpp"
 #include "kfr/io.hpp"
 
-static constexpr int THRESHOLD = 8;
 static constexpr int TIMEOUT = 15;
+static constexpr int VERIFY_SLACK = 1;
+static constexpr int HAMMING_RADIUS = 2;
+static constexpr int VOTE_SLACK = 0;
+
+// fingerprints looked up between decisions
+static constexpr size_t DECISION_STEP = 64;
+// how often the index is checked for new segments or snapshots
+static constexpr int REFRESH_MS = 500;
 
 static constexpr int BUF_SIZE = 2000;
 static constexpr int SAMPLE_RATE = 48000;
 static constexpr int BUFFER_FRAMES = 1200;
 
+static constexpr size_t CACHE_BYTES = 64 * 1024 * 1024;
+static constexpr size_t WARM_KEYS = 1 << 20;
+static constexpr size_t WARM_BATCH = 256;
+static constexpr size_t PROBE_CHUNK = 32;
+
+// what each lookup worker keeps between buffers
+struct worker_state {
+  std::unique_ptr<posting_reader> reader;
+  // probes made by this worker, by store partition
+  std::vector<std::vector<fp_t>> probes;
+  // votes of this worker for the current buffer
+  vote_table votes;
+
+  worker_state(int slack) : votes(slack) {}
+};
+
+// readers of a refreshed index, one per worker, and its neighbour index,
+// built on the refresh thread for the listen loop to swap in
+struct refreshed_index {
+  std::vector<std::unique_ptr<posting_reader>> readers;
+  hamming_index neighbours;
+};
+
 int audio_callback(void *outputBuffer, void *inputBuffer,
              const unsigned int nBufferFrames, double streamTime,
              RtAudioStreamStatus status, void *userData);
 
 void fill_double_bufs(const kfr::univector<kfr::f64> &data);
-void check_fingerprints();
-std::vector<fp_data_t> find_matches(const std::vector<fp_t> &fingerprints);
+void check_fingerprints(posting_store &store, database &songs_db);
+void find_matches(const std::vector<fp_t> &fingerprints,
+                  const std::vector<bit_margins> &margins,
+                  posting_store &store, const database &songs_db,
+                  int elapsed, vote_table &votes);
+bool score_buffer(const std::vector<fp_t> &fingerprints,
+                  const std::vector<bit_margins> &margins,
+                  posting_store &store, const database &songs_db,
+                  int elapsed, vote_table &votes, size_t &looked_up);
+float information_of(const bit_margins &margins);
+void start_workers();
+void refresh_index(posting_store &store);
+bool swap_refreshed();
+bool verify_match(database &songs_db, const std::array<uint8_t, 16> &id,
+                  const std::vector<fp_t> &fingerprints, int offset,
+                  int &verified);
+bool index_neighbours(const posting_store &store, hamming_index &index);
+void add_probes(const fp_t &f, const bit_margins *margins,
+                std::vector<fp_t> &probes);
+void report_progress(const char *what, uint64_t done, uint64_t total);
+bool warm_index(const posting_store &store);
+bool warm_keys(posting_store &store, const std::string &trace_path);
 
 
 #endif
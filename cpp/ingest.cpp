@@ -1,34 +1,49 @@
 #include "ingest.hpp"
 
-int insert_file(const std::string &fullpath) {
+// song ids are the truncated sha256 of the file contents
+bool hash_file(const std::string &fullpath, std::array<unsigned char, 16> &id) {
+  // open file
+  std::ifstream f(fullpath, std::ios::binary);
+  if (f.fail()) {
+    f.close();
+    std::cout << "Error: no such file " << fullpath << std::endl;
+    return false;
+  }
+  picosha2::hash256(f, id.begin(), id.end());
+  f.close();
+  return true;
+}
+
+// fingerprints of a song that is not in the database yet
+int fingerprint_file(const std::string &fullpath, database &song_db,
+                     std::array<unsigned char, 16> &id, std::string &filename,
+                     std::vector<fp_t> &fingerprints) {
   size_t last_slash_idx = fullpath.find_last_of('/');
-  std::string filename;
   if (last_slash_idx != std::string::npos) {
     filename = fullpath.substr(last_slash_idx + 1);
   } else {
     filename = fullpath;
   }
 
-  // open file
-  std::ifstream f(fullpath, std::ios::binary);
-  if (f.fail()) {
-    f.close();
-    std::cout << "Error: no such file " << fullpath << std::endl;
+  // calculate id
+  if (!hash_file(fullpath, id)) {
     return 1;
   }
-  // calculate id
-  std::array<unsigned char, 16> id;
-  picosha2::hash256(f, id.begin(), id.end());
-  f.close();
 
   // check database if song already exists
-  database song_db("songs.db");
   auto song = song_db.get_song(id);
   if (song != "") {
     std::cerr << "Skipping \"" << fullpath << "\"" << std::endl;
     return 1;
   }
 
+  // old postings of a deleted song are still in the index
+  if (song_db.is_deleted(id.data())) {
+    std::cerr << "Skipping deleted \"" << fullpath
+              << "\", run mask_compact first" << std::endl;
+    return 1;
+  }
+
   // read file data
   audio_helper ah;
   auto data = ah.read_from_file(fullpath);
@@ -39,38 +54,304 @@ int insert_file(const std::string &fullpath) {
 
   // generate fingerpritns
   fingerprint fp;
-  auto fingerprints = fp.get_fingerprints(data);
+  fingerprints = fp.get_fingerprints(data);
+  return 0;
+}
 
-  // put fingerprints in database
-  database fp_db("fingerprints.db");
+int insert_file(const std::string &fullpath, size_t num_shards) {
+  database song_db("songs.db");
+  std::array<unsigned char, 16> id;
+  std::string filename;
+  std::vector<fp_t> fingerprints;
+  if (fingerprint_file(fullpath, song_db, id, filename, fingerprints) != 0) {
+    return 1;
+  }
+
+  // group the postings by key, so every list, or bucket of lists, is
+  // rewritten once per song
+  std::map<uint32_t, std::vector<fp_data_t>> lists;
   for (auto &fp : fingerprints) {
     fp_data_t temp;
     std::copy(id.begin(), id.end(), temp.id);
     temp.t = fp.t;
-    fp_db.put_fp(fp.fp, temp);
+    lists[fp.fp].push_back(temp);
+  }
+
+  // put fingerprints in database
+  sharded_database fp_db("fingerprints.db", num_shards);
+  fp_db.append_fp_lists(std::vector<std::pair<uint32_t, std::vector<fp_data_t>>>(
+      lists.begin(), lists.end()));
+  if (!fp_db.commit()) {
+    std::cerr << "Error: could not insert \"" << fullpath
+              << "\", fingerprints.db is in use by identify" << std::endl;
+    return 1;
   }
 
-  // put song into database
+  // put song into database, the forward index first so a song that is
+  // visible always has one
+  song_db.put_forward(id, fingerprints);
   song_db.put_song(id, filename);
+  if (!song_db.commit()) {
+    std::cerr << "Error: could not insert \"" << fullpath
+              << "\", songs.db is in use by identify" << std::endl;
+    return 1;
+  }
 
   std::cerr << "Inserted \"" << fullpath << "\"" << std::endl;
 
   return 0;
 }
 
+// write all given songs as one new segment, the index being read is never
+// modified, identify picks the segment up once it is in the manifest
+int insert_segment(const std::vector<std::string> &paths,
+                   const std::string &dir, size_t max_postings) {
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    std::cerr << "Error: could not create " << dir << std::endl;
+    return 1;
+  }
+
+  database song_db("songs.db");
+  snapshot seg;
+  seg.max_postings = max_postings;
+  std::map<uint32_t, std::vector<fp_data_t>> lists;
+  std::map<std::array<unsigned char, 16>, std::vector<fp_t>> forward;
+  int ret = 0;
+  for (const auto &fullpath : paths) {
+    std::array<unsigned char, 16> id;
+    std::string filename;
+    std::vector<fp_t> fingerprints;
+    if (fingerprint_file(fullpath, song_db, id, filename, fingerprints) != 0 ||
+        seg.songs.count(id) != 0) {
+      ret = 1;
+      continue;
+    }
+
+    for (auto &fp : fingerprints) {
+      fp_data_t temp;
+      std::copy(id.begin(), id.end(), temp.id);
+      temp.t = fp.t;
+      lists[fp.fp].push_back(temp);
+    }
+    seg.songs[id] = filename;
+    forward[id].swap(fingerprints);
+  }
+  if (seg.songs.empty()) {
+    return ret;
+  }
+
+  for (const auto &l : lists) {
+    seg.add_list(l.first, l.second.data(), l.second.size());
+  }
+  std::map<uint32_t, std::vector<fp_data_t>>().swap(lists);
+
+  std::string temp_path = segment_manifest::segment_path(
+      dir, "ingest-" + std::to_string(getpid()) + ".tmp");
+  if (!seg.write(temp_path) || !segment_manifest::sync_file(temp_path)) {
+    std::cerr << "Error: could not write " << temp_path << std::endl;
+    std::remove(temp_path.c_str());
+    return 1;
+  }
+
+  // name the songs before publishing the segment, so a segment in the
+  // manifest never holds songs without a name
+  for (const auto &s : seg.songs) {
+    song_db.put_forward(s.first, forward[s.first]);
+    song_db.put_song(s.first, s.second);
+  }
+  if (!song_db.commit()) {
+    std::cerr << "Error: could not insert the songs, songs.db is in use by "
+                 "identify"
+              << std::endl;
+    std::remove(temp_path.c_str());
+    return 1;
+  }
+
+  // publish the segment, taking the songs out again if that fails
+  std::string name;
+  bool published = false;
+  {
+    manifest_lock lock(dir);
+    segment_manifest manifest;
+    if (!lock.locked() ||
+        (!manifest.read(dir) &&
+         access(segment_manifest::path(dir).c_str(), F_OK) == 0)) {
+      std::cerr << "Error: could not read " << segment_manifest::path(dir)
+                << std::endl;
+    } else {
+      name = manifest.new_segment();
+      manifest.segments.push_back(name);
+      std::string path = segment_manifest::segment_path(dir, name);
+      if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error: could not publish " << name << std::endl;
+      } else if (!manifest.write(dir)) {
+        std::cerr << "Error: could not publish " << name << std::endl;
+        std::remove(path.c_str());
+      } else {
+        published = true;
+      }
+    }
+  }
+  if (!published) {
+    std::remove(temp_path.c_str());
+    for (const auto &s : seg.songs) {
+      song_db.forget_song(s.first);
+    }
+    song_db.commit();
+    return 1;
+  }
+
+  std::cerr << "Inserted " << seg.songs.size() << " songs as " << name << " ("
+            << seg.keys.size() << " keys, " << seg.postings.size()
+            << " postings)" << std::endl;
+
+  return ret;
+}
+
+int delete_file(const std::string &fullpath) {
+  // calculate id
+  std::array<unsigned char, 16> id;
+  if (!hash_file(fullpath, id)) {
+    return 1;
+  }
+
+  // tombstone the song, identify ignores its postings once it is
+  // restarted. a running identify keeps songs.db locked, so the
+  // tombstone cannot be written until it exits
+  database song_db("songs.db");
+  if (song_db.get_song(id) == "") {
+    std::cerr << "Not in database \"" << fullpath << "\"" << std::endl;
+    return 1;
+  }
+  song_db.delete_song(id);
+  if (!song_db.commit()) {
+    std::cerr << "Error: could not delete \"" << fullpath
+              << "\", songs.db is in use by identify" << std::endl;
+    return 1;
+  }
+
+  std::cerr << "Deleted \"" << fullpath << "\"" << std::endl;
+
+  return 0;
+}
+
+void print_usage(const char *name) {
+  std::cout << "Usage: " << name
+            << " [-d] [-b bucket_bits] [-m max_postings] [-s num_shards] "
+               "[-S segment_dir] path/to/file [..]"
+            << std::endl;
+  std::cout << "  -d  delete the given files from the database instead, "
+               "identify must not be running and"
+            << std::endl;
+  std::cout << "      filters them once it is started again" << std::endl;
+  std::cout << "  -b  store the lists of a new index in records of keys sharing "
+               "all but their low bucket_bits bits"
+            << std::endl;
+  std::cout << "  -m  mark keys found in more than max_postings songs as "
+               "stop keys"
+            << std::endl;
+  std::cout << "  -s  split a new index into num_shards files by key hash"
+            << std::endl;
+  std::cout << "  -S  add the files as one new segment of a segmented index, "
+               "identify must not"
+            << std::endl;
+  std::cout << "      hold songs.db while the songs are named" << std::endl;
+}
+
 int main(int argc, char **argv) {
+  // parse options
+  size_t max_postings = 0;
+  size_t num_shards = 0;
+  size_t bucket_bits = 0;
+  bool delete_mode = false;
+  std::string segment_dir;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:dm:s:S:")) != -1) {
+    switch (opt) {
+    case 'b':
+      bucket_bits = std::stoul(optarg);
+      break;
+    case 'd':
+      delete_mode = true;
+      break;
+    case 'm':
+      max_postings = std::stoul(optarg);
+      break;
+    case 's':
+      num_shards = std::stoul(optarg);
+      break;
+    case 'S':
+      segment_dir = optarg;
+      break;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
   // check arguments
-  if (argc < 2) {
-    std::cout << "Usage: " << argv[0] << " path/to/file [..]" << std::endl;
+  if (optind >= argc) {
+    print_usage(argv[0]);
     return 1;
   }
-    
+
+  if (delete_mode) {
+    int ret = 0;
+    for (int i = optind; i < argc; ++i) {
+      ret |= delete_file(argv[i]);
+    }
+    return ret;
+  }
+
+  if (segment_dir != "") {
+    return insert_segment(
+        std::vector<std::string>(argv + optind, argv + argc), segment_dir,
+        max_postings);
+  }
+
+  // keys are routed by hash, so the shard count of an index is fixed
+  size_t existing_shards = sharded_database::count_shards("fingerprints.db");
+  if (existing_shards == 0) {
+    num_shards = std::max<size_t>(num_shards, 1);
+  } else if (num_shards != 0 && num_shards != existing_shards) {
+    std::cerr << "Error: index already has " << existing_shards << " shards"
+              << std::endl;
+    return 1;
+  } else {
+    num_shards = existing_shards;
+  }
+
+  // like the shard count, the bucket layout is fixed once lists are stored
+  if (bucket_bits > database::MAX_BUCKET_BITS) {
+    std::cerr << "Error: at most " << database::MAX_BUCKET_BITS << " bucket bits"
+              << std::endl;
+    return 1;
+  }
+  if (existing_shards == 0) {
+    if (bucket_bits > 0) {
+      sharded_database fp_db("fingerprints.db", num_shards);
+      fp_db.set_bucket_bits(bucket_bits);
+    }
+  } else if (bucket_bits != 0) {
+    sharded_database fp_db("fingerprints.db", num_shards);
+    if (fp_db.get_bucket_bits() != bucket_bits) {
+      std::cerr << "Error: index uses " << fp_db.get_bucket_bits()
+                << " bucket bits, rewrite it with mask_compact -b" << std::endl;
+      return 1;
+    }
+  }
+
+  // store posting cap so both ingest and identify honour it
+  if (max_postings > 0) {
+    sharded_database fp_db("fingerprints.db", num_shards);
+    fp_db.set_max_postings(max_postings);
+  }
+
   int ret = 0;
-  for (int i = 1; i < argc; ++i) {
+  for (int i = optind; i < argc; ++i) {
       std::string fullpath(argv[i]);
-      ret |= insert_file(fullpath);
+      ret |= insert_file(fullpath, num_shards);
   }
 
   return ret;
 }
-
@@ -4,9 +4,18 @@
 #include <iostream>
 #include <string>
 #include <array>
+#include <cerrno>
+#include <cstdio>
+#include <map>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "audio_helper.hpp"
 #include "database.hpp"
+#include "sharded_database.hpp"
 #include "fingerprint.hpp"
+#include "segment_manifest.hpp"
+#include "snapshot.hpp"
 #include "PicoSHA2/picosha2.h"
 #include "types.hpp"
 
@@ -0,0 +1,139 @@
+#include "io_ring.hpp"
+
+io_ring::io_ring()
+    : ring_fd(-1), sq_entries(0), to_submit(0), sq_ptr(nullptr),
+      sq_bytes(0), cq_ptr(nullptr), cq_bytes(0), sqes(nullptr),
+      sqes_bytes(0) {}
+
+io_ring::~io_ring() { release(); }
+
+bool io_ring::init(unsigned entries) {
+  release();
+
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (ring_fd < 0) {
+    ring_fd = -1;
+    return false;
+  }
+  sq_entries = params.sq_entries;
+
+  // map the submission ring, completion ring and submission entries
+  sq_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_bytes = cq_bytes = std::max(sq_bytes, cq_bytes);
+  }
+  sq_ptr = mmap(nullptr, sq_bytes, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (sq_ptr == MAP_FAILED) {
+    sq_ptr = nullptr;
+    release();
+    return false;
+  }
+  if (single_mmap) {
+    cq_ptr = sq_ptr;
+  } else {
+    cq_ptr = mmap(nullptr, cq_bytes, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ptr == MAP_FAILED) {
+      cq_ptr = nullptr;
+      release();
+      return false;
+    }
+  }
+  sqes_bytes = params.sq_entries * sizeof(io_uring_sqe);
+  void *p = mmap(nullptr, sqes_bytes, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (p == MAP_FAILED) {
+    release();
+    return false;
+  }
+  sqes = static_cast<io_uring_sqe *>(p);
+
+  auto sq = static_cast<uint8_t *>(sq_ptr);
+  sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  auto cq = static_cast<uint8_t *>(cq_ptr);
+  cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  return true;
+}
+
+bool io_ring::ok() const { return ring_fd >= 0; }
+
+// queue a read, returns false while the submission ring is full
+bool io_ring::prep_read(int fd, void *buf, uint32_t len, uint64_t offset,
+                        uint64_t user_data) {
+  unsigned tail = *sq_tail;
+  unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+  if (tail - head >= sq_entries) {
+    return false;
+  }
+
+  unsigned idx = tail & *sq_mask;
+  io_uring_sqe *sqe = &sqes[idx];
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(buf);
+  sqe->len = len;
+  sqe->off = offset;
+  sqe->user_data = user_data;
+  sq_array[idx] = idx;
+  __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ++to_submit;
+  return true;
+}
+
+// hand queued reads to the kernel and wait for wait_nr completions
+int io_ring::submit_and_wait(unsigned wait_nr) {
+  int ret;
+  do {
+    ret = syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_nr,
+                  wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+  } while (ret < 0 && errno == EINTR);
+  if (ret >= 0) {
+    to_submit -= std::min<unsigned>(ret, to_submit);
+  }
+  return ret;
+}
+
+// take one completion if there is one, res is the read's return value
+bool io_ring::pop(uint64_t &user_data, int &res) {
+  unsigned head = *cq_head;
+  if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+  const io_uring_cqe &cqe = cqes[head & *cq_mask];
+  user_data = cqe.user_data;
+  res = cqe.res;
+  __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+void io_ring::release() {
+  if (sqes) {
+    munmap(sqes, sqes_bytes);
+  }
+  if (cq_ptr && cq_ptr != sq_ptr) {
+    munmap(cq_ptr, cq_bytes);
+  }
+  if (sq_ptr) {
+    munmap(sq_ptr, sq_bytes);
+  }
+  if (ring_fd >= 0) {
+    close(ring_fd);
+  }
+  ring_fd = -1;
+  to_submit = 0;
+  sq_ptr = nullptr;
+  cq_ptr = nullptr;
+  sqes = nullptr;
+}
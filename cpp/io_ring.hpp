@@ -0,0 +1,54 @@
+#ifndef _IO_RING_H
+#define _IO_RING_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// minimal single-threaded io_uring submission and completion queue, used
+// through the raw system calls so no liburing is needed. init() fails on
+// kernels or sandboxes without io_uring and callers then use pread
+class io_ring {
+  public:
+    io_ring();
+    ~io_ring();
+    io_ring(const io_ring &) = delete;
+    io_ring &operator=(const io_ring &) = delete;
+
+    bool init(unsigned entries);
+    bool ok() const;
+    bool prep_read(int fd, void *buf, uint32_t len, uint64_t offset,
+                   uint64_t user_data);
+    int submit_and_wait(unsigned wait_nr);
+    bool pop(uint64_t &user_data, int &res);
+
+  private:
+    void release();
+
+    int ring_fd;
+    unsigned sq_entries;
+    unsigned to_submit;
+    void *sq_ptr;
+    size_t sq_bytes;
+    void *cq_ptr;
+    size_t cq_bytes;
+    io_uring_sqe *sqes;
+    size_t sqes_bytes;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    io_uring_cqe *cqes;
+};
+
+#endif
@@ -0,0 +1,509 @@
+#include "mask_bench.hpp"
+
+struct bench_options {
+  std::string snapshot_path;
+  std::string segment_dir;
+  size_t cache_bytes = 0;
+  int repeats = 5;
+  size_t batch = 0;
+  bool cold = false;
+  int max_radius = 3;
+  placement where;
+};
+
+struct bench_result {
+  double p50;
+  double p99;
+  double throughput;
+  double dtlb_misses;
+  size_t postings;
+  uint64_t checksum;
+};
+
+void print_usage(const char *name) {
+  std::cout << "Usage: " << name
+            << " [-b backend] [-s snapshot] [-g segment_dir] [-c cache_mib] "
+               "[-H pages] [-N numa] [-B batch] [-C] [-n repeats] "
+               "[-R radius] path/to/trace"
+            << std::endl;
+  std::cout << "  -b  unqlite, tiered, memory, mmap, file, segments or all "
+               "(default)"
+            << std::endl;
+  std::cout << "      placement compares page and NUMA settings of memory"
+            << std::endl;
+  std::cout << "      hamming compares probing every variant of a key with "
+               "the neighbour index"
+            << std::endl;
+  std::cout << "  -s  snapshot used by the mmap, file and memory backends"
+            << std::endl;
+  std::cout << "  -g  segment directory, all includes segments if given"
+            << std::endl;
+  std::cout << "  -c  posting cache size of the unqlite backend, RAM tier size "
+               "of the tiered backend"
+            << std::endl;
+  std::cout << "  -H  normal, thp or hugetlb pages of the memory backend"
+            << std::endl;
+  std::cout << "  -N  none, interleave or replicate the memory backend over "
+               "NUMA nodes"
+            << std::endl;
+  std::cout << "  -B  look keys up in batches of this size, latencies are "
+               "per batch"
+            << std::endl;
+  std::cout << "  -C  drop the snapshot from the page cache before each timed "
+               "lookup"
+            << std::endl;
+  std::cout << "  -n  number of untimed replays for throughput" << std::endl;
+  std::cout << "  -R  largest hamming radius compared by hamming (default 3)"
+            << std::endl;
+}
+
+// resident set size of this process
+size_t current_rss() {
+  std::ifstream f("/proc/self/statm");
+  size_t pages_total = 0;
+  size_t pages_resident = 0;
+  f >> pages_total >> pages_resident;
+  return pages_resident * sysconf(_SC_PAGESIZE);
+}
+
+// proportional set size, pages shared with other processes count only
+// their share, so summing it over processes gives host memory use
+size_t current_pss() {
+  std::ifstream f("/proc/self/smaps_rollup");
+  std::string field;
+  size_t kib = 0;
+  while (f >> field) {
+    if (field == "Pss:") {
+      f >> kib;
+      break;
+    }
+  }
+  return kib * 1024;
+}
+
+// user space data TLB load misses of this thread, -1 where perf events
+// are not available
+int open_dtlb_counter() {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+uint64_t read_counter(int fd) {
+  uint64_t count = 0;
+  if (fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count)) {
+    return 0;
+  }
+  return count;
+}
+
+// evict a file's clean pages so the next reads go to the disk
+void drop_page_cache(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+std::vector<uint32_t> read_trace(const std::string &path) {
+  std::ifstream f(path, std::ios::binary | std::ios::ate);
+  std::vector<uint32_t> keys(f.tellg() / sizeof(uint32_t));
+  f.seekg(0);
+  f.read(reinterpret_cast<char *>(keys.data()),
+         keys.size() * sizeof(uint32_t));
+  return keys;
+}
+
+std::unique_ptr<posting_store> open_backend(const std::string &backend,
+                                            const bench_options &options) {
+  if (backend == "unqlite") {
+    if (sharded_database::count_shards("fingerprints.db") == 0) {
+      return nullptr;
+    }
+    return std::unique_ptr<posting_store>(
+        new unqlite_store("fingerprints.db", options.cache_bytes));
+  } else if (backend == "tiered") {
+    if (sharded_database::count_shards("fingerprints.db") == 0) {
+      return nullptr;
+    }
+    return std::unique_ptr<posting_store>(
+        new tiered_store("fingerprints.db", options.cache_bytes));
+  } else if (backend == "memory") {
+    std::unique_ptr<memory_index> index(new memory_index());
+    if (options.snapshot_path != "") {
+      if (!index->load(options.snapshot_path)) {
+        return nullptr;
+      }
+    } else {
+      if (sharded_database::count_shards("fingerprints.db") == 0) {
+        return nullptr;
+      }
+      sharded_database fp_db("fingerprints.db");
+      index->load(fp_db);
+    }
+    if (!index->place(options.where)) {
+      return nullptr;
+    }
+    return std::unique_ptr<posting_store>(index.release());
+  } else if (backend == "mmap") {
+    std::unique_ptr<mmap_store> mapped(new mmap_store());
+    if (options.snapshot_path == "" ||
+        !mapped->open(options.snapshot_path)) {
+      return nullptr;
+    }
+    return std::unique_ptr<posting_store>(mapped.release());
+  } else if (backend == "file") {
+    std::unique_ptr<file_store> file(new file_store());
+    if (options.snapshot_path == "" || !file->open(options.snapshot_path)) {
+      return nullptr;
+    }
+    return std::unique_ptr<posting_store>(file.release());
+  } else if (backend == "segments") {
+    std::unique_ptr<segment_store> segments(new segment_store());
+    if (options.segment_dir == "" || !segments->open(options.segment_dir)) {
+      return nullptr;
+    }
+    return std::unique_ptr<posting_store>(segments.release());
+  }
+  return nullptr;
+}
+
+bench_result measure(posting_store &store, const std::vector<uint32_t> &keys,
+                     const bench_options &options) {
+  bench_result result;
+
+  // timed replay, one clock read per probe or batch
+  auto reader = store.reader();
+  size_t step = std::max<size_t>(options.batch, 1);
+  std::vector<double> latencies;
+  result.postings = 0;
+  // read every posting like find_matches does, so batches that prefetch
+  // posting data are compared against single probes that pay for it
+  uint64_t checksum = 0;
+  auto count = [&result, &checksum](size_t, posting_list list) {
+    result.postings += list.size;
+    for (size_t j = 0; j < list.size; ++j) {
+      checksum += list.data[j].t;
+    }
+  };
+  for (size_t i = 0; i < keys.size(); i += step) {
+    if (options.cold) {
+      drop_page_cache(options.snapshot_path);
+    }
+    size_t n = std::min(step, keys.size() - i);
+    auto t0 = std::chrono::steady_clock::now();
+    if (options.batch > 0) {
+      reader->find_batch(keys.data() + i, n, count);
+    } else {
+      count(i, reader->find(keys[i]));
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    latencies.push_back(
+        std::chrono::duration<double, std::nano>(t1 - t0).count());
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  // untimed replays for throughput and TLB misses
+  int dtlb = open_dtlb_counter();
+  if (dtlb >= 0) {
+    ioctl(dtlb, PERF_EVENT_IOC_RESET, 0);
+    ioctl(dtlb, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < options.repeats; ++r) {
+    if (options.batch > 0) {
+      for (size_t i = 0; i < keys.size(); i += step) {
+        reader->find_batch(keys.data() + i,
+                           std::min(step, keys.size() - i), count);
+      }
+    } else {
+      for (size_t i = 0; i < keys.size(); ++i) {
+        count(i, reader->find(keys[i]));
+      }
+    }
+  }
+  std::chrono::duration<double> replay_time =
+      std::chrono::steady_clock::now() - start;
+  size_t probes = std::max<size_t>(options.repeats * keys.size(), 1);
+  result.dtlb_misses = -1;
+  if (dtlb >= 0) {
+    ioctl(dtlb, PERF_EVENT_IOC_DISABLE, 0);
+    result.dtlb_misses = static_cast<double>(read_counter(dtlb)) / probes;
+    close(dtlb);
+  }
+
+  result.checksum = checksum;
+  result.p50 = latencies.empty() ? 0 : latencies[latencies.size() / 2];
+  result.p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+  result.throughput = options.repeats * keys.size() / replay_time.count();
+  return result;
+}
+
+std::string format_tlb(double misses) {
+  if (misses < 0) {
+    return "n/a";
+  }
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(3) << misses;
+  return ss.str();
+}
+
+int run_backend(const std::string &backend, const std::vector<uint32_t> &keys,
+                const bench_options &options) {
+  size_t rss_before = current_rss();
+  size_t pss_before = current_pss();
+  auto start = std::chrono::steady_clock::now();
+  auto store = open_backend(backend, options);
+  if (!store) {
+    std::cerr << backend << ": not available" << std::endl;
+    return 1;
+  }
+  std::chrono::duration<double> load_time =
+      std::chrono::steady_clock::now() - start;
+
+  auto result = measure(*store, keys, options);
+  size_t rss_after = current_rss();
+  size_t pss_after = current_pss();
+
+  std::cout << std::fixed << std::setprecision(1) << std::left
+            << std::setw(8) << store->name() << " load "
+            << load_time.count() * 1000 << " ms, p50 " << result.p50
+            << " ns, p99 " << result.p99 << " ns, "
+            << result.throughput / 1e6 << " M probes/s, dtlb "
+            << format_tlb(result.dtlb_misses) << " misses/probe, rss +"
+            << (rss_after - rss_before) / (1024.0 * 1024.0) << " MiB, pss +"
+            << (pss_after - pss_before) / (1024.0 * 1024.0) << " MiB ("
+            << result.postings << " postings, checksum " << result.checksum
+            << ")" << std::endl;
+  if (store->stats() != "") {
+    std::cout << "         " << store->stats() << std::endl;
+  }
+  return 0;
+}
+
+// replay the trace against the memory backend under each page and NUMA
+// setting, reporting the change against normal pages without NUMA policy
+int run_placements(const std::vector<uint32_t> &keys,
+                   bench_options options) {
+  options.where = placement();
+  auto store = open_backend("memory", options);
+  if (!store) {
+    std::cerr << "memory: not available" << std::endl;
+    return 1;
+  }
+  auto &index = static_cast<memory_index &>(*store);
+
+  std::vector<numa_mode> numa_modes = {numa_mode::none};
+  if (numa_topology().num_nodes() > 1) {
+    numa_modes.push_back(numa_mode::interleave);
+    numa_modes.push_back(numa_mode::replicate);
+  }
+
+  bool have_baseline = false;
+  bench_result baseline;
+  for (auto pages :
+       {page_mode::normal, page_mode::transparent, page_mode::hugetlb}) {
+    for (auto numa : numa_modes) {
+      placement where;
+      where.pages = pages;
+      where.numa = numa;
+      if (!index.place(where)) {
+        std::cerr << "placement failed" << std::endl;
+        return 1;
+      }
+
+      // each run pins itself to a replica, so it gets its own thread
+      bench_result result;
+      std::thread runner(
+          [&]() { result = measure(index, keys, options); });
+      runner.join();
+      if (!have_baseline) {
+        baseline = result;
+        have_baseline = true;
+      }
+
+      std::cout << std::fixed << std::setprecision(1) << std::left
+                << std::setw(40) << index.placement_info() << " p50 "
+                << result.p50 << " ns (" << std::showpos
+                << result.p50 - baseline.p50 << "), p99 " << std::noshowpos
+                << result.p99 << " ns (" << std::showpos
+                << result.p99 - baseline.p99 << "), " << std::noshowpos
+                << result.throughput / 1e6 << " M probes/s, dtlb "
+                << format_tlb(result.dtlb_misses);
+      if (result.dtlb_misses >= 0 && baseline.dtlb_misses >= 0) {
+        std::cout << " (" << std::showpos
+                  << format_tlb(result.dtlb_misses - baseline.dtlb_misses)
+                  << std::noshowpos << ")";
+      }
+      std::cout << " misses/probe" << std::endl;
+    }
+  }
+  return 0;
+}
+
+// look up every key within each hamming radius of the trace keys, once by
+// probing all variants and once through the neighbour index, on the memory
+// backend. both must find the same keys
+int run_hamming(const std::vector<uint32_t> &keys,
+                const bench_options &options) {
+  auto store = open_backend("memory", options);
+  if (!store) {
+    std::cerr << "memory: not available" << std::endl;
+    return 1;
+  }
+  std::vector<uint32_t> stored;
+  store->scan_keys([&stored](uint32_t key) { stored.push_back(key); });
+  auto reader = store->reader();
+
+  std::vector<uint32_t> found;
+  for (int radius = 0; radius <= options.max_radius; ++radius) {
+    size_t probes = 0, enum_found = 0, enum_postings = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t key : keys) {
+      found.clear();
+      hamming_index::enumerate(key, radius, found);
+      probes += found.size();
+      for (uint32_t variant : found) {
+        posting_list list = reader->find(variant);
+        enum_found += list.size > 0;
+        enum_postings += list.size;
+      }
+    }
+    std::chrono::duration<double, std::nano> enum_time =
+        std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    hamming_index neighbours;
+    neighbours.build(stored, radius);
+    std::chrono::duration<double> build_time =
+        std::chrono::steady_clock::now() - start;
+
+    size_t compared = 0, index_found = 0, index_postings = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t key : keys) {
+      found.clear();
+      compared += neighbours.search(key, found);
+      index_found += found.size();
+      for (uint32_t neighbour : found) {
+        index_postings += reader->find(neighbour).size;
+      }
+    }
+    std::chrono::duration<double, std::nano> index_time =
+        std::chrono::steady_clock::now() - start;
+
+    double n = std::max<size_t>(keys.size(), 1);
+    std::cout << std::fixed << std::setprecision(1) << "radius " << radius
+              << ": probe " << probes / n << " variants, "
+              << enum_time.count() / n << " ns/key; index "
+              << neighbours.num_tables() << " tables, " << compared / n
+              << " compared, " << index_time.count() / n << " ns/key, built in "
+              << build_time.count() * 1000 << " ms, "
+              << neighbours.memory_bytes() / (1024.0 * 1024.0) << " MiB; "
+              << index_found / n << " keys, " << index_postings / n
+              << " postings per key" << std::endl;
+    if (index_found != enum_found || index_postings != enum_postings) {
+      std::cerr << "radius " << radius << ": index found " << index_found
+                << " keys, probing found " << enum_found << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  // parse options
+  std::string backend = "all";
+  bench_options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:s:g:c:H:N:B:Cn:R:")) != -1) {
+    switch (opt) {
+    case 'b':
+      backend = optarg;
+      break;
+    case 's':
+      options.snapshot_path = optarg;
+      break;
+    case 'g':
+      options.segment_dir = optarg;
+      break;
+    case 'c':
+      options.cache_bytes = std::stoul(optarg) * 1024 * 1024;
+      break;
+    case 'H':
+      if (!page_region::parse_mode(optarg, options.where.pages)) {
+        print_usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'N':
+      if (!memory_index::parse_numa_mode(optarg, options.where.numa)) {
+        print_usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'B':
+      options.batch = std::stoul(optarg);
+      break;
+    case 'C':
+      options.cold = true;
+      break;
+    case 'n':
+      options.repeats = std::stoi(optarg);
+      break;
+    case 'R':
+      options.max_radius = std::stoi(optarg);
+      if (options.max_radius < 0 ||
+          options.max_radius > hamming_index::MAX_RADIUS) {
+        print_usage(argv[0]);
+        return 1;
+      }
+      break;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  auto keys = read_trace(argv[optind]);
+  std::cout << keys.size() << " probes in trace" << std::endl;
+
+  if (backend == "placement") {
+    return run_placements(keys, options);
+  } else if (backend == "hamming") {
+    return run_hamming(keys, options);
+  } else if (backend != "all") {
+    return run_backend(backend, keys, options);
+  }
+
+  // run each backend in its own process so memory use is not shared
+  std::vector<std::string> backends = {"unqlite", "tiered", "memory", "mmap",
+                                       "file"};
+  if (options.segment_dir != "") {
+    backends.push_back("segments");
+  }
+  int ret = 0;
+  for (const auto &b : backends) {
+    std::cout << std::flush;
+    pid_t pid = fork();
+    if (pid == 0) {
+      exit(run_backend(b, keys, options));
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ret |= WEXITSTATUS(status);
+  }
+  return ret;
+}
@@ -0,0 +1,34 @@
+#ifndef _MASK_BENCH_H
+#define _MASK_BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "file_store.hpp"
+#include "hamming_index.hpp"
+#include "memory_index.hpp"
+#include "mmap_store.hpp"
+#include "numa_topology.hpp"
+#include "page_region.hpp"
+#include "posting_store.hpp"
+#include "segment_store.hpp"
+#include "sharded_database.hpp"
+#include "tiered_store.hpp"
+#include "unqlite_store.hpp"
+
+#endif
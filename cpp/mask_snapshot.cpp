@@ -0,0 +1,111 @@
+#include "mask_snapshot.hpp"
+
+void print_usage(const char *name) {
+  std::cout << "Usage: " << name << " export path/to/snapshot" << std::endl;
+  std::cout << "       " << name
+            << " import [-s num_shards] [-b bucket_bits] path/to/snapshot"
+            << std::endl;
+}
+
+int export_snapshot(const std::string &path) {
+  auto start = std::chrono::steady_clock::now();
+
+  if (sharded_database::count_shards("fingerprints.db") == 0) {
+    std::cerr << "Error: no fingerprints.db" << std::endl;
+    return 1;
+  }
+  sharded_database fp_db("fingerprints.db");
+  database song_db("songs.db");
+
+  snapshot snap;
+  snap.from_database(fp_db, song_db);
+
+  // write beside the target and rename it into place, so processes mapping
+  // the old snapshot never see a partial file
+  std::string temp_path = path + ".tmp";
+  if (!snap.write(temp_path) ||
+      std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    std::cerr << "Error: could not write " << path << std::endl;
+    std::remove(temp_path.c_str());
+    return 1;
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cerr << "Exported " << snap.songs.size() << " songs, "
+            << snap.keys.size() << " keys, " << snap.postings.size()
+            << " postings in " << elapsed.count() << " s" << std::endl;
+  return 0;
+}
+
+int import_snapshot(const std::string &path, size_t num_shards,
+                    size_t bucket_bits) {
+  auto start = std::chrono::steady_clock::now();
+
+  // never merge into an existing index
+  if (sharded_database::count_shards("fingerprints.db") != 0) {
+    std::cerr << "Error: fingerprints.db already exists" << std::endl;
+    return 1;
+  }
+
+  snapshot snap;
+  if (!snap.read(path)) {
+    std::cerr << "Error: bad snapshot " << path << std::endl;
+    return 1;
+  }
+
+  sharded_database fp_db("fingerprints.db", num_shards);
+  database song_db("songs.db");
+  if (bucket_bits > 0) {
+    fp_db.set_bucket_bits(bucket_bits);
+  }
+  snap.to_database(fp_db, song_db);
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cerr << "Imported " << snap.songs.size() << " songs, "
+            << snap.keys.size() << " keys, " << snap.postings.size()
+            << " postings in " << elapsed.count() << " s" << std::endl;
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  std::string command(argv[1]);
+
+  // parse options after the command
+  size_t num_shards = 1;
+  size_t bucket_bits = 0;
+  int opt;
+  optind = 2;
+  while ((opt = getopt(argc, argv, "b:s:")) != -1) {
+    switch (opt) {
+    case 'b':
+      bucket_bits = std::stoul(optarg);
+      break;
+    case 's':
+      num_shards = std::stoul(optarg);
+      break;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind != argc - 1 || bucket_bits > database::MAX_BUCKET_BITS) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  std::string path(argv[optind]);
+
+  if (command == "export") {
+    return export_snapshot(path);
+  } else if (command == "import") {
+    return import_snapshot(path, num_shards, bucket_bits);
+  }
+
+  print_usage(argv[0]);
+  return 1;
+}
@@ -0,0 +1,13 @@
+#ifndef _MASK_SNAPSHOT_H
+#define _MASK_SNAPSHOT_H
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include "database.hpp"
+#include "sharded_database.hpp"
+#include "snapshot.hpp"
+
+#endif
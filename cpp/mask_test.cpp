@@ -0,0 +1,575 @@
+#include "mask_test.hpp"
+
+bool check(bool ok, const char *what) {
+  if (!ok) {
+    std::cerr << "  failed: " << what << std::endl;
+  }
+  return ok;
+}
+
+static std::array<unsigned char, 16> song_id(uint8_t n) {
+  std::array<unsigned char, 16> id;
+  id.fill(0);
+  id[0] = n;
+  return id;
+}
+
+static fp_data_t posting(uint8_t song, int32_t t) {
+  fp_data_t p;
+  std::memset(p.id, 0, sizeof(p.id));
+  p.id[0] = song;
+  p.t = t;
+  return p;
+}
+
+// two songs, two lists and a stop key
+static snapshot small_snapshot() {
+  snapshot snap;
+  snap.max_postings = 3;
+  snap.songs[song_id(1)] = "one";
+  snap.songs[song_id(2)] = "two";
+  std::vector<fp_data_t> a = {posting(1, 10), posting(2, 20)};
+  std::vector<fp_data_t> b = {posting(2, 30)};
+  std::vector<fp_data_t> c = {posting(1, 1), posting(2, 2), posting(3, 3),
+                              posting(4, 4)};
+  snap.add_list(5, a.data(), a.size());
+  snap.add_list(9, b.data(), b.size());
+  snap.add_list(12, c.data(), c.size());
+  return snap;
+}
+
+static bool same_list(posting_list list, const std::vector<int32_t> &times) {
+  if (list.size != times.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < list.size; ++i) {
+    if (list.data[i].t != times[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool test_snapshot_round_trip() {
+  bool ok = true;
+  snapshot snap = small_snapshot();
+  ok &= check(snap.stop_keys == std::vector<uint32_t>(1, 12),
+              "list over the cap becomes a stop key");
+  ok &= check(snap.write(TEST_SNAPSHOT), "write");
+
+  snapshot back;
+  ok &= check(back.read(TEST_SNAPSHOT), "read");
+  ok &= check(back.max_postings == 3, "read max_postings");
+  ok &= check(back.songs == snap.songs, "read songs");
+  ok &= check(back.stop_keys == snap.stop_keys, "read stop keys");
+  ok &= check(back.keys.size() == 2 && back.postings.size() == 3,
+              "read lists");
+  for (size_t i = 0; i < back.keys.size() && i < snap.keys.size(); ++i) {
+    ok &= check(back.keys[i].key == snap.keys[i].key &&
+                    back.keys[i].size == snap.keys[i].size &&
+                    back.keys[i].offset == snap.keys[i].offset,
+                "read key directory");
+  }
+
+  mmap_store mapped;
+  ok &= check(mapped.open(TEST_SNAPSHOT, true), "mmap open");
+  ok &= check(same_list(mapped.find(5), {10, 20}), "mmap find 5");
+  ok &= check(same_list(mapped.find(9), {30}), "mmap find 9");
+  ok &= check(mapped.find(7).size == 0, "mmap find missing key");
+  ok &= check(mapped.get_song(song_id(2)) == "two", "mmap song name");
+
+  file_store file;
+  ok &= check(file.open(TEST_SNAPSHOT, true), "file open");
+  auto reader = file.reader();
+  ok &= check(same_list(reader->find(5), {10, 20}), "file find 5");
+  ok &= check(reader->find(12).size == 0, "file find stop key");
+
+  std::remove(TEST_SNAPSHOT);
+  return ok;
+}
+
+// version 2 files hold the same sections, but their checksum leaves the
+// header out, so a written file is turned into one by rehashing it
+bool test_snapshot_v2() {
+  bool ok = true;
+  snapshot snap = small_snapshot();
+  ok &= check(snap.write(TEST_SNAPSHOT), "write");
+
+  std::vector<char> bytes(file_size(TEST_SNAPSHOT));
+  std::fstream f(TEST_SNAPSHOT,
+                 std::ios::in | std::ios::out | std::ios::binary);
+  f.read(bytes.data(), bytes.size());
+  snapshot_header header;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  snapshot_hasher hasher;
+  hasher.update(bytes.data() + header.header_bytes,
+                header.file_bytes - header.header_bytes);
+  header.version = 2;
+  header.checksum = hasher.digest();
+  f.seekp(0);
+  f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  f.close();
+
+  snapshot back;
+  ok &= check(back.read(TEST_SNAPSHOT), "read");
+  ok &= check(back.songs == snap.songs, "read songs");
+  ok &= check(back.keys.size() == 2 && back.postings.size() == 3,
+              "read lists");
+  for (size_t i = 0; i < back.keys.size() && i < snap.keys.size(); ++i) {
+    ok &= check(back.keys[i].key == snap.keys[i].key &&
+                    back.keys[i].size == snap.keys[i].size &&
+                    back.keys[i].offset == snap.keys[i].offset,
+                "read key directory");
+  }
+
+  mmap_store mapped;
+  ok &= check(mapped.open(TEST_SNAPSHOT, true), "mmap open");
+  ok &= check(same_list(mapped.find(9), {30}), "mmap find 9");
+  file_store file;
+  ok &= check(file.open(TEST_SNAPSHOT, true), "file open");
+  ok &= check(same_list(file.reader()->find(5), {10, 20}), "file find 5");
+
+  std::remove(TEST_SNAPSHOT);
+  return ok;
+}
+
+// overwrite n bytes at offset of the test snapshot
+static void patch(uint64_t offset, const void *data, size_t n) {
+  std::fstream f(TEST_SNAPSHOT, std::ios::in | std::ios::out |
+                                    std::ios::binary);
+  f.seekp(offset);
+  f.write(static_cast<const char *>(data), n);
+}
+
+static bool rejected(const char *what, bool verify) {
+  bool ok = true;
+  snapshot snap;
+  mmap_store mapped;
+  file_store file;
+  std::string name = what;
+  ok &= check(!snap.read(TEST_SNAPSHOT), (name + ", read").c_str());
+  ok &= check(!mapped.open(TEST_SNAPSHOT, verify),
+              (name + ", mmap open").c_str());
+  ok &= check(!file.open(TEST_SNAPSHOT, verify),
+              (name + ", file open").c_str());
+  return ok;
+}
+
+bool test_snapshot_corrupt() {
+  bool ok = true;
+  snapshot snap = small_snapshot();
+  uint64_t bad = 1ull << 40;
+  uint64_t size = 0;
+
+  snap.write(TEST_SNAPSHOT);
+  patch(0, "MASKSNAQ", 8);
+  ok &= rejected("bad magic", false);
+
+  snap.write(TEST_SNAPSHOT);
+  patch(offsetof(snapshot_header, num_postings), &bad, sizeof(bad));
+  ok &= rejected("postings past the end", false);
+
+  snap.write(TEST_SNAPSHOT);
+  patch(offsetof(snapshot_header, num_songs), &bad, sizeof(bad));
+  ok &= rejected("too many songs", false);
+
+  snap.write(TEST_SNAPSHOT);
+  patch(offsetof(snapshot_header, keys_offset), &size, sizeof(size));
+  ok &= rejected("sections out of order", false);
+
+  // a directory pointing past the postings
+  snap.write(TEST_SNAPSHOT);
+  uint64_t fewer = snap.postings.size() - 1;
+  patch(offsetof(snapshot_header, num_postings), &fewer, sizeof(fewer));
+  ok &= rejected("lists past the postings", false);
+
+  // a zero sample of the offsets that does not match their bits
+  snap.write(TEST_SNAPSHOT);
+  snapshot_header written;
+  std::ifstream(TEST_SNAPSHOT, std::ios::binary)
+      .read(reinterpret_cast<char *>(&written), sizeof(written));
+  patch(written.postings_offset - sizeof(bad), &bad, sizeof(bad));
+  ok &= rejected("bad directory sample", false);
+
+  snap.write(TEST_SNAPSHOT);
+  size = file_size(TEST_SNAPSHOT);
+  ok &= check(truncate(TEST_SNAPSHOT, size - 8) == 0, "truncate");
+  ok &= rejected("truncated file", false);
+
+  // only a checked open reads every byte
+  snap.write(TEST_SNAPSHOT);
+  snapshot_header header;
+  std::ifstream(TEST_SNAPSHOT, std::ios::binary)
+      .read(reinterpret_cast<char *>(&header), sizeof(header));
+  int32_t t = 99;
+  patch(header.postings_offset + offsetof(fp_data_t, t), &t, sizeof(t));
+  ok &= rejected("flipped posting", true);
+  mmap_store mapped;
+  ok &= check(mapped.open(TEST_SNAPSHOT), "unchecked open of bad checksum");
+
+  std::remove(TEST_SNAPSHOT);
+  return ok;
+}
+
+bool test_vote_table() {
+  bool ok = true;
+  auto a = song_id(1), b = song_id(2);
+
+  vote_table votes;
+  for (int i = 0; i < 3; ++i) {
+    votes.add(a.data(), 5);
+  }
+  votes.add(b.data(), 7);
+  votes.add(b.data(), 7);
+  ok &= check(votes.best_score() == 3 && votes.best_offset() == 5 &&
+                  votes.best_id() == a,
+              "best of one table");
+  ok &= check(votes.size() == 2 && votes.total_score() == 5, "counts");
+
+  // enough cells to make the table grow
+  vote_table other;
+  other.add(b.data(), 7);
+  other.add(b.data(), 7);
+  for (int32_t dt = 0; dt < 10000; ++dt) {
+    other.add(a.data(), 100 + dt);
+  }
+  votes.absorb(other);
+  ok &= check(votes.best_score() == 4 && votes.best_offset() == 7 &&
+                  votes.best_id() == b,
+              "best after absorb");
+  ok &= check(votes.size() == 10002, "cells after absorb");
+
+  votes.clear();
+  ok &= check(votes.best_score() == 0 && votes.size() == 0 &&
+                  votes.total_score() == 0,
+              "clear");
+  votes.add(a.data(), 1);
+  ok &= check(votes.best_score() == 1, "reuse after clear");
+
+  // with slack, votes at neighbouring offsets add up
+  vote_table slack(1);
+  slack.add(a.data(), 5);
+  slack.add(a.data(), 6);
+  slack.add(a.data(), 9);
+  ok &= check(slack.best_score() == 2, "slack window");
+  return ok;
+}
+
+bool test_decide() {
+  bool ok = true;
+  auto a = song_id(1);
+
+  vote_table votes;
+  for (int i = 0; i < THRESHOLD - 1; ++i) {
+    votes.add(a.data(), 5);
+  }
+  ok &= check(!decide(votes, 1000, decision_rule::threshold),
+              "threshold not reached");
+  votes.add(a.data(), 5);
+  ok &= check(decide(votes, 1000, decision_rule::threshold),
+              "threshold reached");
+
+  // the rate rule starts lower and rises to the threshold, elapsed counts
+  // 10 ms steps
+  vote_table rate;
+  for (int i = 0; i < THRESHOLD_RATE_MIN; ++i) {
+    rate.add(a.data(), 5);
+  }
+  ok &= check(decide(rate, 100, decision_rule::rate), "rate early");
+  ok &= check(!decide(rate, 3000, decision_rule::rate), "rate late");
+
+  // one strong peak over a flat background
+  vote_table likely;
+  for (int32_t dt = 0; dt < 2000; ++dt) {
+    likely.add(song_id(dt % 200 + 2).data(), dt);
+  }
+  for (int i = 0; i < MIN_SCORE - 1; ++i) {
+    likely.add(a.data(), 5);
+  }
+  ok &= check(!decide(likely, 100, decision_rule::likelihood),
+              "likelihood under the minimum score");
+  for (int i = 0; i < 10; ++i) {
+    likely.add(a.data(), 5);
+  }
+  ok &= check(likely.background_log10() <= FALSE_ALARM_LOG10,
+              "background of a strong peak");
+  ok &= check(decide(likely, 100, decision_rule::likelihood),
+              "likelihood reached");
+
+  decision_rule rule;
+  ok &= check(parse_rule("rate", rule) && rule == decision_rule::rate,
+              "parse rule");
+  ok &= check(!parse_rule("vote", rule), "parse unknown rule");
+  return ok;
+}
+
+bool test_elias_fano() {
+  bool ok = true;
+  std::mt19937 rng(1);
+  std::vector<uint64_t> values;
+  uint64_t v = 0;
+  for (size_t i = 0; i < 3 * elias_fano::SAMPLE + 17; ++i) {
+    v += rng() % 40 == 0 ? 0 : rng() % 1000;
+    values.push_back(v);
+  }
+
+  elias_fano ef;
+  ef.build(values.size(), [&values](size_t i) { return values[i]; });
+  ok &= check(ef.size() == values.size(), "size");
+
+  bool got = true;
+  elias_fano::cursor cursor(ef);
+  for (size_t i = 0; i < values.size(); ++i) {
+    got &= ef.get(i) == values[i] && cursor.next() == values[i];
+    if (i + 1 < values.size()) {
+      uint64_t first, second;
+      ef.get_pair(i, first, second);
+      got &= first == values[i] && second == values[i + 1];
+    }
+  }
+  ok &= check(got, "get, get_pair and cursor");
+
+  bool found = true;
+  for (int q = 0; q < 2000; ++q) {
+    uint64_t x = rng() % (values.back() + 10);
+    size_t lb = std::lower_bound(values.begin(), values.end(), x) -
+                values.begin();
+    found &= ef.lower_bound(x) == lb;
+    size_t i = ef.find(x);
+    if (lb < values.size() && values[lb] == x) {
+      found &= i != elias_fano::NOT_FOUND && values[i] == x;
+    } else {
+      found &= i == elias_fano::NOT_FOUND;
+    }
+  }
+  ok &= check(found, "find and lower_bound");
+
+  elias_fano view;
+  ok &= check(view.attach(ef.data(), ef.num_words()), "attach");
+  ok &= check(view.size() == values.size() &&
+                  view.get(values.size() - 1) == values.back(),
+              "attached get");
+  return ok;
+}
+
+static float cost_of(uint32_t flips, const bit_margins &margins) {
+  float cost = 0;
+  for (int i = 0; i < MASK_BITS; ++i) {
+    if (flips & 1u << i) {
+      cost += margins[i];
+    }
+  }
+  return cost;
+}
+
+bool test_probe_generator() {
+  bool ok = true;
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> margin(0.01f, 1.0f);
+  bit_margins margins;
+  for (auto &m : margins) {
+    m = margin(rng);
+  }
+  uint32_t key = 0x2a5a5a;
+
+  std::vector<uint32_t> keys;
+  probe_generator all(2);
+  all.generate(key, margins, keys);
+  ok &= check(keys.size() == 1 + MASK_BITS + MASK_BITS * (MASK_BITS - 1) / 2,
+              "every key within radius 2");
+  ok &= check(!keys.empty() && keys[0] == key, "key itself first");
+  bool ordered = true;
+  for (size_t i = 1; i < keys.size(); ++i) {
+    ordered &= __builtin_popcount(keys[i] ^ key) <= 2;
+    ordered &= cost_of(keys[i - 1] ^ key, margins) <=
+               cost_of(keys[i] ^ key, margins) + 1e-5f;
+  }
+  ok &= check(ordered, "cheapest flips first");
+  ok &= check(std::set<uint32_t>(keys.begin(), keys.end()).size() ==
+                  keys.size(),
+              "no key twice");
+
+  // the budget cuts the same sequence short
+  std::vector<uint32_t> few;
+  probe_generator budget(2, MASK_BITS, 10);
+  budget.generate(key, margins, few);
+  ok &= check(few.size() == 10 &&
+                  std::equal(few.begin(), few.end(), keys.begin()),
+              "budget");
+
+  // only the least reliable bits are flipped
+  std::vector<int> order(MASK_BITS);
+  for (int i = 0; i < MASK_BITS; ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(),
+            [&margins](int a, int b) { return margins[a] < margins[b]; });
+  uint32_t allowed = 0;
+  for (int i = 0; i < 4; ++i) {
+    allowed |= 1u << order[i];
+  }
+  std::vector<uint32_t> toggled;
+  probe_generator toggle(2, 4);
+  toggle.generate(key, margins, toggled);
+  bool inside = toggled.size() == 1 + 4 + 6;
+  for (uint32_t k : toggled) {
+    inside &= ((k ^ key) & ~allowed) == 0;
+  }
+  ok &= check(inside, "toggle bits");
+  return ok;
+}
+
+bool test_hamming_index() {
+  bool ok = true;
+  std::mt19937 rng(3);
+  const uint32_t mask_bits = (1u << MASK_BITS) - 1;
+  const uint32_t band = 3u << MASK_BITS;
+
+  // keys clustered around a few centres, so searches find some
+  std::vector<uint32_t> centres;
+  for (int i = 0; i < 20; ++i) {
+    centres.push_back(band | (rng() & mask_bits));
+  }
+  std::set<uint32_t> keys;
+  for (int i = 0; i < 5000; ++i) {
+    uint32_t k = centres[rng() % centres.size()];
+    for (int f = rng() % 5; f > 0; --f) {
+      k ^= 1u << (rng() % MASK_BITS);
+    }
+    keys.insert(k);
+  }
+
+  for (int radius : {1, 2, 3}) {
+    hamming_index index;
+    index.build(std::vector<uint32_t>(keys.begin(), keys.end()), radius);
+    ok &= check(index.num_keys() == keys.size() &&
+                    index.num_tables() == static_cast<size_t>(radius) + 1,
+                "build");
+    bool same = true;
+    for (uint32_t q : centres) {
+      std::vector<uint32_t> found;
+      index.search(q, found);
+      std::set<uint32_t> expected;
+      for (uint32_t k : keys) {
+        if (__builtin_popcount((k ^ q) & mask_bits) <= radius) {
+          expected.insert(k);
+        }
+      }
+      same &= found.size() == expected.size() &&
+              std::set<uint32_t>(found.begin(), found.end()) == expected;
+    }
+    ok &= check(same, "search matches a linear scan");
+  }
+  return ok;
+}
+
+static void remove_db() {
+  std::remove(TEST_DB);
+  std::remove((std::string(TEST_DB) + "_unqlite_journal").c_str());
+}
+
+bool test_tombstones() {
+  bool ok = true;
+  auto a = song_id(1), b = song_id(2);
+  remove_db();
+  {
+    database db(TEST_DB);
+    db.put_song(a, "one");
+    db.put_song(b, "two");
+    ok &= check(!db.is_deleted(a.data()), "live song");
+    db.delete_song(a);
+    ok &= check(db.is_deleted(a.data()) && !db.is_deleted(b.data()),
+                "deleted song");
+    ok &= check(db.get_song(a) == "" && db.get_song(b) == "two",
+                "deleted song has no name");
+    ok &= check(db.commit(), "commit");
+  }
+  {
+    database db(TEST_DB, 0, true);
+    ok &= check(db.is_deleted(a.data()), "tombstone reloaded");
+    auto tombstones = db.get_tombstones();
+    ok &= check(tombstones.size() == 1 && tombstones.count(a) == 1,
+                "tombstone set");
+
+    // segments still holding the song have to be merged first
+    snapshot snap = small_snapshot();
+    snap.write(TEST_SNAPSHOT);
+    mmap_store segment;
+    ok &= check(segment.open(TEST_SNAPSHOT) &&
+                    segment.holds_any_song(tombstones),
+                "segment holds a deleted song");
+    snap.songs.erase(a);
+    snap.write(TEST_SNAPSHOT);
+    mmap_store clean;
+    ok &= check(clean.open(TEST_SNAPSHOT) && !clean.holds_any_song(tombstones),
+                "clean segment");
+    std::remove(TEST_SNAPSHOT);
+  }
+  {
+    database db(TEST_DB);
+    db.clear_tombstones();
+    ok &= check(!db.is_deleted(a.data()) && db.get_tombstones().empty(),
+                "clear tombstones");
+  }
+  remove_db();
+  return ok;
+}
+
+bool test_stats() {
+  bool ok = true;
+  remove_db();
+  {
+    database db(TEST_DB);
+    db.put_song(song_id(1), "one");
+    db.put_song(song_id(2), "two");
+    db.append_fp_lists({{1, {posting(1, 1), posting(2, 2)}},
+                        {2, {posting(1, 3)}}});
+    db.append_fp_lists({{2, {posting(2, 4)}}});
+    catalogue_stats stats = {0, 0, 0, 0};
+    ok &= check(db.get_stats(stats), "get stats");
+    ok &= check(stats.songs == 2 && stats.keys == 2 && stats.postings == 4 &&
+                    stats.bytes == 4 * sizeof(fp_data_t),
+                "running counters");
+    db.delete_song(song_id(2));
+    ok &= check(db.commit(), "commit");
+  }
+  {
+    database db(TEST_DB);
+    catalogue_stats stored = {0, 0, 0, 0};
+    ok &= check(db.get_stats(stored) && stored.songs == 1 &&
+                    stored.postings == 4,
+                "stored counters");
+    db.recount_stats();
+    catalogue_stats counted = {0, 0, 0, 0};
+    ok &= check(db.get_stats(counted) && counted.songs == stored.songs &&
+                    counted.keys == stored.keys &&
+                    counted.postings == stored.postings &&
+                    counted.bytes == stored.bytes,
+                "recount agrees");
+  }
+  remove_db();
+  return ok;
+}
+
+int main() {
+  std::vector<std::pair<const char *, std::function<bool()>>> tests = {
+      {"snapshot round trip", test_snapshot_round_trip},
+      {"snapshot version 2", test_snapshot_v2},
+      {"snapshot corrupt", test_snapshot_corrupt},
+      {"vote table", test_vote_table},
+      {"decide", test_decide},
+      {"elias fano", test_elias_fano},
+      {"probe generator", test_probe_generator},
+      {"hamming index", test_hamming_index},
+      {"tombstones", test_tombstones},
+      {"stats", test_stats},
+  };
+
+  int failed = 0;
+  for (const auto &t : tests) {
+    bool ok = t.second();
+    std::cout << (ok ? "ok      " : "FAILED  ") << t.first << std::endl;
+    failed += ok ? 0 : 1;
+  }
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+#ifndef _MASK_TEST_H
+#define _MASK_TEST_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "database.hpp"
+#include "decision.hpp"
+#include "elias_fano.hpp"
+#include "file_store.hpp"
+#include "hamming_index.hpp"
+#include "mmap_store.hpp"
+#include "probe_generator.hpp"
+#include "snapshot.hpp"
+#include "types.hpp"
+#include "vote_table.hpp"
+
+// files are written to the working directory and removed again
+static constexpr const char *TEST_SNAPSHOT = "mask_test.snap";
+static constexpr const char *TEST_DB = "mask_test.db";
+
+bool check(bool ok, const char *what);
+bool test_snapshot_round_trip();
+bool test_snapshot_v2();
+bool test_snapshot_corrupt();
+bool test_vote_table();
+bool test_decide();
+bool test_elias_fano();
+bool test_probe_generator();
+bool test_hamming_index();
+bool test_tombstones();
+bool test_stats();
+
+#endif
@@ -0,0 +1,329 @@
+#include "memory_index.hpp"
+
+memory_reader::memory_reader(const memory_index &index, size_t replica)
+    : index(index), replica(replica) {}
+
+posting_list memory_reader::find(uint32_t key) {
+  return index.find(key, replica);
+}
+
+void memory_reader::find_batch(
+    const uint32_t *keys, size_t n,
+    const std::function<void(size_t, posting_list)> &fn) {
+  // resolve the whole batch first, fetching the table slot of the key
+  // SLOT_AHEAD steps ahead and the posting head of each key found
+  lists.resize(n);
+  for (size_t i = 0; i < n && i < SLOT_AHEAD; ++i) {
+    __builtin_prefetch(index.slot_address(keys[i], replica));
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if (i + SLOT_AHEAD < n) {
+      __builtin_prefetch(index.slot_address(keys[i + SLOT_AHEAD], replica));
+    }
+    lists[i] = index.find(keys[i], replica);
+    if (lists[i].size > 0) {
+      __builtin_prefetch(lists[i].data);
+    }
+  }
+
+  // by now the posting heads of the batch have arrived
+  for (size_t i = 0; i < n; ++i) {
+    fn(i, lists[i]);
+  }
+}
+
+memory_index::memory_index()
+    : next_replica(0), n_postings(0), n_slots(0), n_keys(0), load_time(0) {
+  band_base.fill(0);
+  band_mask.fill(0);
+  band_shift.fill(63);
+}
+
+void memory_index::load(sharded_database &db) {
+  auto start = std::chrono::steady_clock::now();
+
+  // copy every posting list into the arena
+  std::vector<slot> entries;
+  arena.clear();
+  for (size_t s = 0; s < db.num_shards(); ++s) {
+    db.shard(s).scan_fp(
+        [this, &entries](uint32_t key, const std::vector<fp_data_t> &value) {
+          entries.push_back({key, static_cast<uint32_t>(value.size()),
+                             arena.size()});
+          arena.insert(arena.end(), value.begin(), value.end());
+        });
+  }
+  arena.shrink_to_fit();
+  build_table(entries);
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  load_time = elapsed.count();
+}
+
+// load postings and song names from a snapshot with sequential reads
+bool memory_index::load(const std::string &snapshot_path) {
+  auto start = std::chrono::steady_clock::now();
+
+  snapshot snap;
+  if (!snap.read(snapshot_path)) {
+    return false;
+  }
+
+  // the snapshot's postings already form a key ordered arena
+  arena.swap(snap.postings);
+  songs.swap(snap.songs);
+  std::vector<slot> entries;
+  entries.reserve(snap.keys.size());
+  for (const auto &k : snap.keys) {
+    entries.push_back({k.key, k.size, k.offset});
+  }
+  build_table(entries);
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  load_time = elapsed.count();
+  return true;
+}
+
+posting_list memory_index::find(uint32_t key, size_t replica) const {
+  if (views.empty()) {
+    return {nullptr, 0};
+  }
+  const view &v = views[replica];
+
+  // linear probing within the band's sub-table, which is never more than
+  // half full
+  uint32_t band = band_of(key);
+  const slot *table = v.table + band_base[band];
+  size_t mask = band_mask[band];
+  for (size_t i = band_slot_of(key, band);; i = (i + 1) & mask) {
+    const slot &s = table[i];
+    if (s.key == key) {
+      return {v.arena + s.offset, s.size};
+    }
+    if (s.key == EMPTY_KEY) {
+      return {nullptr, 0};
+    }
+  }
+}
+
+// the caller prefetches the address itself, gcc drops calls to a function
+// that does nothing but prefetch as having no effect
+const void *memory_index::slot_address(uint32_t key, size_t replica) const {
+  if (views.empty()) {
+    return nullptr;
+  }
+  return &views[replica].table[slot_of(key)];
+}
+
+// lookups only read the table and arena, so readers share them directly.
+// with one replica per node, readers take turns between the nodes and pin
+// the calling thread to the node whose replica they read
+std::unique_ptr<posting_reader> memory_index::reader() {
+  size_t replica = 0;
+  if (views.size() > 1) {
+    replica = next_replica++ % views.size();
+    topology.pin_thread(replica_nodes[replica]);
+  }
+  return std::unique_ptr<posting_reader>(new memory_reader(*this, replica));
+}
+
+size_t memory_index::num_partitions() const { return MAX_BANDS; }
+
+size_t memory_index::partition_of(uint32_t key) const { return band_of(key); }
+
+bool memory_index::scan_keys(
+    const std::function<void(uint32_t)> &fn) const {
+  if (views.empty()) {
+    return true;
+  }
+  const slot *table = views[0].table;
+  for (size_t i = 0; i < n_slots; ++i) {
+    if (table[i].key != EMPTY_KEY) {
+      fn(table[i].key);
+    }
+  }
+  return true;
+}
+
+std::vector<fp_data_t> memory_index::get_fp(uint32_t key) const {
+  auto list = find(key);
+  return std::vector<fp_data_t>(list.data, list.data + list.size);
+}
+
+size_t memory_index::num_keys() const { return n_keys; }
+
+size_t memory_index::num_postings() const { return n_postings; }
+
+size_t memory_index::memory_bytes() const {
+  size_t bytes = table.capacity() * sizeof(slot) +
+                 arena.capacity() * sizeof(fp_data_t);
+  for (const auto &r : replicas) {
+    bytes += r->table.size() + r->arena.size();
+  }
+  return bytes;
+}
+
+double memory_index::load_seconds() const { return load_time; }
+
+std::string memory_index::get_song(std::array<unsigned char, 16> key) const {
+  auto it = songs.find(key);
+  return it == songs.end() ? "" : it->second;
+}
+
+std::string memory_index::name() const { return "memory"; }
+
+size_t memory_index::slot_of(uint32_t key) const {
+  uint32_t band = band_of(key);
+  return band_base[band] + band_slot_of(key, band);
+}
+
+size_t memory_index::band_slot_of(uint32_t key, uint32_t band) const {
+  // fibonacci hashing, taking the top bits of the product. the keys of a
+  // band share their high bits, and the low key bits alone are poorly
+  // distributed
+  return static_cast<uint64_t>(key) * 0x9e3779b97f4a7c15ull >>
+         band_shift[band];
+}
+
+void memory_index::build_table(const std::vector<slot> &entries) {
+  // per band the smallest power of two at least twice its number of keys,
+  // and at least two slots so that bands without keys stay cheap
+  std::array<size_t, MAX_BANDS> band_keys;
+  band_keys.fill(0);
+  for (const auto &e : entries) {
+    ++band_keys[band_of(e.key)];
+  }
+  n_slots = 0;
+  for (uint32_t b = 0; b < MAX_BANDS; ++b) {
+    size_t capacity = 2;
+    int bits = 1;
+    while (capacity < 2 * band_keys[b]) {
+      capacity *= 2;
+      ++bits;
+    }
+    band_base[b] = n_slots;
+    band_mask[b] = capacity - 1;
+    band_shift[b] = 64 - bits;
+    n_slots += capacity;
+  }
+
+  table.assign(n_slots, {EMPTY_KEY, 0, 0});
+  table.shrink_to_fit();
+  n_keys = entries.size();
+
+  for (const auto &e : entries) {
+    uint32_t band = band_of(e.key);
+    size_t i = band_slot_of(e.key, band);
+    while (table[band_base[band] + i].key != EMPTY_KEY) {
+      i = (i + 1) & band_mask[band];
+    }
+    table[band_base[band] + i] = e;
+  }
+
+  n_postings = arena.size();
+  replicas.clear();
+  views.assign(1, {table.data(), arena.data()});
+  replica_nodes.assign(1, 0);
+}
+
+// move the table and arena onto the requested pages and nodes. settings
+// the machine cannot honour fall back, placement_info() tells what was used
+bool memory_index::place(const placement &p) {
+  if (views.empty()) {
+    return false;
+  }
+
+  // pages interleave over every node with memory, but a replica is only
+  // worth keeping on a node whose CPUs can read it locally
+  std::vector<size_t> nodes;
+  for (size_t node = 0; node < topology.num_nodes(); ++node) {
+    if (p.numa == numa_mode::interleave || !topology.cpus(node).empty()) {
+      nodes.push_back(node);
+    }
+  }
+  placement actual = p;
+  if (nodes.size() < 2) {
+    actual.numa = numa_mode::none;
+  }
+  if (actual.numa != numa_mode::replicate) {
+    nodes.assign(1, 0);
+  }
+
+  // build the new copies from the current first copy
+  std::vector<std::unique_ptr<replica>> next(nodes.size());
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    next[i].reset(new replica());
+    if (!copy_replica(*next[i], actual, nodes[i])) {
+      return false;
+    }
+  }
+  actual.pages = next[0]->arena.mode();
+
+  views.clear();
+  for (const auto &r : next) {
+    views.push_back({static_cast<const slot *>(r->table.data()),
+                     static_cast<const fp_data_t *>(r->arena.data())});
+  }
+  replicas.swap(next);
+  replica_nodes.swap(nodes);
+  std::vector<slot>().swap(table);
+  std::vector<fp_data_t>().swap(arena);
+  placed = actual;
+  return true;
+}
+
+std::string memory_index::placement_info() const {
+  std::string numa = "none";
+  if (placed.numa == numa_mode::interleave) {
+    numa = "interleaved over " + std::to_string(topology.num_nodes());
+  } else if (placed.numa == numa_mode::replicate) {
+    numa = "replicated on " + std::to_string(replica_nodes.size());
+  }
+  return page_region::mode_name(placed.pages) + " pages, numa " + numa +
+         (placed.numa == numa_mode::none ? "" : " nodes");
+}
+
+bool memory_index::parse_numa_mode(const std::string &name, numa_mode &mode) {
+  if (name == "none") {
+    mode = numa_mode::none;
+  } else if (name == "interleave") {
+    mode = numa_mode::interleave;
+  } else if (name == "replicate") {
+    mode = numa_mode::replicate;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// the copy is written by a thread on the target node, so the pages land
+// there by first touch even where binding them is not permitted
+bool memory_index::copy_replica(replica &r, const placement &p,
+                                size_t node) const {
+  size_t table_bytes = n_slots * sizeof(slot);
+  size_t arena_bytes = n_postings * sizeof(fp_data_t);
+  if (!r.table.allocate(table_bytes, p.pages) ||
+      !r.arena.allocate(arena_bytes, p.pages)) {
+    return false;
+  }
+  if (p.numa == numa_mode::interleave) {
+    r.table.interleave(topology.ids());
+    r.arena.interleave(topology.ids());
+  } else if (p.numa == numa_mode::replicate) {
+    r.table.bind_node(topology.id(node));
+    r.arena.bind_node(topology.id(node));
+  }
+
+  const view &src = views[0];
+  std::thread copier([&]() {
+    if (p.numa == numa_mode::replicate) {
+      topology.pin_thread(node);
+    }
+    std::memcpy(r.table.data(), src.table, table_bytes);
+    std::memcpy(r.arena.data(), src.arena, arena_bytes);
+  });
+  copier.join();
+  return true;
+}
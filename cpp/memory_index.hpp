@@ -0,0 +1,126 @@
+#ifndef _MEMORY_INDEX_H
+#define _MEMORY_INDEX_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "numa_topology.hpp"
+#include "page_region.hpp"
+#include "posting_store.hpp"
+#include "sharded_database.hpp"
+#include "snapshot.hpp"
+#include "types.hpp"
+
+// how a NUMA machine spreads the index over its nodes
+enum class numa_mode { none, interleave, replicate };
+
+// memory backing the table and posting arena of a loaded index
+struct placement {
+  page_mode pages = page_mode::normal;
+  numa_mode numa = numa_mode::none;
+};
+
+class memory_index;
+
+// reader bound to one replica of the index. batches prefetch the table
+// slot of the key SLOT_AHEAD steps ahead and the posting head of every key
+// found before handing any list out, so the cache misses of many keys
+// overlap instead of being taken one after another
+class memory_reader : public posting_reader {
+  public:
+    memory_reader(const memory_index &index, size_t replica);
+    posting_list find(uint32_t key) override;
+    void find_batch(const uint32_t *keys, size_t n,
+                    const std::function<void(size_t, posting_list)> &fn)
+        override;
+
+    static constexpr size_t SLOT_AHEAD = 16;
+
+  private:
+    const memory_index &index;
+    size_t replica;
+    std::vector<posting_list> lists;
+};
+
+// read-only copy of the fingerprint index held entirely in RAM, using an
+// open-addressing hash table keyed by fingerprint and one posting arena.
+// the table is cut into one sub-table per band, so all probes of a
+// fingerprint stay within its band's region, and bands are partitions
+// looked up on threads of their own. after loading, place() can move
+// table and arena onto huge pages and interleave or replicate them over
+// the NUMA nodes
+class memory_index : public posting_store {
+  public:
+    memory_index();
+    void load(sharded_database &db);
+    bool load(const std::string &snapshot_path);
+    bool place(const placement &p);
+    std::string placement_info() const;
+    static bool parse_numa_mode(const std::string &name, numa_mode &mode);
+    posting_list find(uint32_t key, size_t replica = 0) const;
+    const void *slot_address(uint32_t key, size_t replica = 0) const;
+    std::unique_ptr<posting_reader> reader() override;
+    size_t num_partitions() const override;
+    size_t partition_of(uint32_t key) const override;
+    bool scan_keys(const std::function<void(uint32_t)> &fn) const override;
+    std::vector<fp_data_t> get_fp(uint32_t key) const;
+    size_t num_keys() const;
+    size_t num_postings() const;
+    size_t memory_bytes() const override;
+    double load_seconds() const;
+    std::string get_song(std::array<unsigned char, 16> key) const override;
+    std::string name() const override;
+
+  private:
+    struct slot {
+      uint32_t key;
+      uint32_t size;
+      uint64_t offset;
+    };
+
+    // table and arena copy on placed pages
+    struct replica {
+      page_region table;
+      page_region arena;
+    };
+
+    struct view {
+      const slot *table;
+      const fp_data_t *arena;
+    };
+
+    static constexpr uint32_t EMPTY_KEY = 0xffffffff;
+
+    size_t slot_of(uint32_t key) const;
+    size_t band_slot_of(uint32_t key, uint32_t band) const;
+    void build_table(const std::vector<slot> &entries);
+    bool copy_replica(replica &r, const placement &p, size_t node) const;
+
+    std::vector<slot> table;
+    std::vector<fp_data_t> arena;
+    std::vector<std::unique_ptr<replica>> replicas;
+    std::vector<view> views;
+    numa_topology topology;
+    std::vector<size_t> replica_nodes;
+    placement placed;
+    std::atomic<size_t> next_replica;
+    size_t n_postings;
+    std::map<std::array<unsigned char, 16>, std::string> songs;
+    std::array<size_t, MAX_BANDS> band_base;
+    std::array<size_t, MAX_BANDS> band_mask;
+    std::array<int, MAX_BANDS> band_shift;
+    size_t n_slots;
+    size_t n_keys;
+    double load_time;
+};
+
+#endif
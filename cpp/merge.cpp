@@ -0,0 +1,235 @@
+#include "merge.hpp"
+
+void print_usage(const char *name) {
+  std::cout << "Usage: " << name
+            << " [-a] [-f fanout] [-b MiB/s] [-w seconds] [segment_dir]"
+            << std::endl;
+  std::cout << "  -a  merge every segment into one, dropping the postings "
+               "of deleted songs"
+            << std::endl;
+  std::cout << "  -f  merge once fanout segments of similar size exist"
+            << std::endl;
+  std::cout << "  -b  limit merge reads and writes to MiB/s" << std::endl;
+  std::cout << "  -w  keep running, checking for work every few seconds"
+            << std::endl;
+}
+
+// smallest run of similarly sized segments, empty if there is no work.
+// with all, a lone segment is still rewritten while it holds deleted songs
+std::vector<std::string>
+pick_segments(const std::string &dir, const segment_manifest &manifest,
+              size_t fanout, bool all,
+              const std::set<std::array<unsigned char, 16>> &tombstones) {
+  std::vector<std::pair<size_t, std::string>> sizes;
+  for (const auto &name : manifest.segments) {
+    sizes.emplace_back(
+        file_size(segment_manifest::segment_path(dir, name)), name);
+  }
+  std::sort(sizes.begin(), sizes.end());
+
+  std::vector<std::string> picked;
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    if (!all && i > 0 && sizes[i].first > SIZE_RATIO * sizes[i - 1].first) {
+      break;
+    }
+    picked.push_back(sizes[i].second);
+  }
+
+  if (all && picked.size() == 1) {
+    mmap_store segment;
+    if (segment.open(segment_manifest::segment_path(dir, picked[0])) &&
+        segment.holds_any_song(tombstones)) {
+      return picked;
+    }
+  }
+  if (picked.size() < (all ? 2 : fanout)) {
+    picked.clear();
+  }
+  return picked;
+}
+
+// union of the given segments as one new segment, swapped into the
+// manifest in their place
+int merge_segments(const std::string &dir,
+                   const std::vector<std::string> &names,
+                   const std::set<std::array<unsigned char, 16>> &tombstones,
+                   io_budget &budget) {
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::unique_ptr<mmap_store>> inputs;
+  for (const auto &name : names) {
+    inputs.emplace_back(new mmap_store());
+    if (!inputs.back()->open(segment_manifest::segment_path(dir, name))) {
+      std::cerr << "Error: bad segment " << name << std::endl;
+      return 1;
+    }
+  }
+
+  // combine song tables, stop lists and the posting cap
+  snapshot out;
+  std::set<uint32_t> stop_keys;
+  std::vector<std::pair<uint32_t, posting_list>> lists;
+  for (const auto &in : inputs) {
+    out.max_postings =
+        std::max<uint64_t>(out.max_postings, in->get_max_postings());
+    for (const auto &s : in->get_songs()) {
+      if (tombstones.find(s.first) == tombstones.end()) {
+        out.songs.insert(s);
+      }
+    }
+    for (uint32_t key : in->get_stop_keys()) {
+      stop_keys.insert(key);
+    }
+    in->scan([&lists](uint32_t key, posting_list list) {
+      lists.emplace_back(key, list);
+    });
+  }
+  std::stable_sort(lists.begin(), lists.end(),
+                   [](const std::pair<uint32_t, posting_list> &a,
+                      const std::pair<uint32_t, posting_list> &b) {
+                     return a.first < b.first;
+                   });
+
+  // concatenate the lists of each key, dropping postings of deleted songs
+  std::vector<fp_data_t> value;
+  for (size_t i = 0; i < lists.size();) {
+    uint32_t key = lists[i].first;
+    value.clear();
+    for (; i < lists.size() && lists[i].first == key; ++i) {
+      const auto &list = lists[i].second;
+      budget.spend(list.size * sizeof(fp_data_t));
+      for (size_t j = 0; j < list.size; ++j) {
+        std::array<unsigned char, 16> id;
+        std::copy(list.data[j].id, list.data[j].id + 16, id.begin());
+        if (tombstones.find(id) == tombstones.end()) {
+          value.push_back(list.data[j]);
+        }
+      }
+    }
+    if (stop_keys.find(key) == stop_keys.end() && !value.empty()) {
+      out.add_list(key, value.data(), value.size());
+    }
+  }
+  std::vector<std::pair<uint32_t, posting_list>>().swap(lists);
+  stop_keys.insert(out.stop_keys.begin(), out.stop_keys.end());
+  out.stop_keys.assign(stop_keys.begin(), stop_keys.end());
+
+  std::string temp_path = segment_manifest::segment_path(
+      dir, "merge-" + std::to_string(getpid()) + ".tmp");
+  if (!out.write(temp_path, &budget) ||
+      !segment_manifest::sync_file(temp_path)) {
+    std::cerr << "Error: could not write " << temp_path << std::endl;
+    std::remove(temp_path.c_str());
+    return 1;
+  }
+
+  // swap the new segment in, readers still holding the old ones keep them
+  // mapped until they are done
+  std::string name;
+  {
+    manifest_lock lock(dir);
+    segment_manifest manifest;
+    if (!lock.locked() || !manifest.read(dir)) {
+      std::cerr << "Error: could not read " << segment_manifest::path(dir)
+                << std::endl;
+      std::remove(temp_path.c_str());
+      return 1;
+    }
+
+    std::set<std::string> merged(names.begin(), names.end());
+    std::vector<std::string> segments;
+    name = manifest.new_segment();
+    for (const auto &s : manifest.segments) {
+      if (merged.erase(s) == 0) {
+        segments.push_back(s);
+      } else if (segments.empty() || segments.back() != name) {
+        segments.push_back(name);
+      }
+    }
+    if (!merged.empty()) {
+      std::cerr << "Error: segments changed during the merge" << std::endl;
+      std::remove(temp_path.c_str());
+      return 1;
+    }
+    manifest.segments = segments;
+
+    if (std::rename(temp_path.c_str(),
+                    segment_manifest::segment_path(dir, name).c_str()) != 0 ||
+        !manifest.write(dir)) {
+      std::cerr << "Error: could not publish " << name << std::endl;
+      std::remove(temp_path.c_str());
+      return 1;
+    }
+  }
+  for (const auto &s : names) {
+    std::remove(segment_manifest::segment_path(dir, s).c_str());
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cerr << "Merged " << names.size() << " segments into " << name << " ("
+            << out.songs.size() << " songs, " << out.keys.size() << " keys, "
+            << out.postings.size() << " postings) in " << elapsed.count()
+            << " s" << std::endl;
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  // parse options
+  bool all = false;
+  size_t fanout = 4;
+  size_t mib_per_sec = 0;
+  int interval = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "af:b:w:")) != -1) {
+    switch (opt) {
+    case 'a':
+      all = true;
+      break;
+    case 'f':
+      fanout = std::max<size_t>(std::stoul(optarg), 2);
+      break;
+    case 'b':
+      mib_per_sec = std::stoul(optarg);
+      break;
+    case 'w':
+      interval = std::stoi(optarg);
+      break;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (argc - optind > 1) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  std::string dir = optind < argc ? argv[optind] : "segments";
+
+  while (true) {
+    segment_manifest manifest;
+    if (!manifest.read(dir)) {
+      std::cerr << "Error: no segments in " << dir << std::endl;
+      return 1;
+    }
+
+    std::set<std::array<unsigned char, 16>> tombstones;
+    {
+      database song_db("songs.db");
+      tombstones = song_db.get_tombstones();
+    }
+    auto names = pick_segments(dir, manifest, fanout, all, tombstones);
+    if (!names.empty()) {
+      io_budget budget(mib_per_sec * 1024 * 1024);
+      if (merge_segments(dir, names, tombstones, budget) != 0) {
+        return 1;
+      }
+      continue;
+    }
+
+    if (interval <= 0) {
+      return 0;
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(interval));
+  }
+}
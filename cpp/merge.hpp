@@ -0,0 +1,27 @@
+#ifndef _MERGE_H
+#define _MERGE_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "database.hpp"
+#include "mmap_store.hpp"
+#include "segment_manifest.hpp"
+#include "snapshot.hpp"
+#include "types.hpp"
+
+// segments are merged when they are within this factor of the next
+// smaller one, so each segment is rewritten about log(n) times
+static constexpr size_t SIZE_RATIO = 4;
+
+#endif
@@ -0,0 +1,196 @@
+#include "mmap_store.hpp"
+
+mmap_store::mmap_store()
+    : map(nullptr), map_bytes(0), header(nullptr), stop_keys(nullptr),
+      postings(nullptr) {}
+
+mmap_store::~mmap_store() { close(); }
+
+bool mmap_store::open(const std::string &path, bool verify) {
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(snapshot_header)) {
+    ::close(fd);
+    return false;
+  }
+
+  // shared read-only mapping, pages come straight from the page cache
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+  map = static_cast<uint8_t *>(addr);
+  map_bytes = st.st_size;
+
+  // every section must lie within the mapping before pointers into it
+  // are formed, a truncated file would fault every process sharing it
+  header = reinterpret_cast<const snapshot_header *>(map);
+  if (!snapshot::check_header(*header, map_bytes)) {
+    close();
+    return false;
+  }
+
+  // hashing touches every page, so it is only done on request
+  if (verify) {
+    snapshot_hasher hasher;
+    snapshot::hash_header(*header, hasher);
+    hasher.update(map + header->header_bytes,
+                  header->file_bytes - header->header_bytes);
+    if (hasher.digest() != header->checksum) {
+      close();
+      return false;
+    }
+  }
+
+  stop_keys =
+      reinterpret_cast<const uint32_t *>(map + header->stop_keys_offset);
+  postings =
+      reinterpret_cast<const fp_data_t *>(map + header->postings_offset);
+
+  bool ok;
+  if (header->version == SNAPSHOT_TABLE_VERSION) {
+    ok = directory.build(
+        reinterpret_cast<const snapshot_key *>(map + header->keys_offset),
+        header->num_keys, header->num_postings);
+  } else {
+    ok = directory.attach(
+        reinterpret_cast<const uint64_t *>(map + header->keys_offset),
+        (header->postings_offset - header->keys_offset) / sizeof(uint64_t),
+        header->num_postings);
+  }
+  if (!ok || directory.size() != header->num_keys) {
+    close();
+    return false;
+  }
+
+  if (!snapshot::decode_songs(map + header->songs_offset,
+                              header->stop_keys_offset - header->songs_offset,
+                              header->num_songs, songs)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+posting_list mmap_store::find(uint32_t key) const {
+  uint64_t offset;
+  uint32_t size;
+  if (!directory.find(key, offset, size)) {
+    return {nullptr, 0};
+  }
+  return {postings + offset, size};
+}
+
+// the mapping is read-only, so readers share it directly
+std::unique_ptr<posting_reader> mmap_store::reader() {
+  return std::unique_ptr<posting_reader>(new direct_reader<mmap_store>(*this));
+}
+
+size_t mmap_store::num_partitions() const { return MAX_BANDS; }
+
+size_t mmap_store::partition_of(uint32_t key) const { return band_of(key); }
+
+bool mmap_store::scan_keys(const std::function<void(uint32_t)> &fn) const {
+  directory.scan([&fn](uint32_t key, uint64_t, uint32_t) { fn(key); });
+  return true;
+}
+
+// ask for the whole mapping, then fault it in page by page so it is
+// resident and mapped when this returns
+bool mmap_store::warm_up(const warm_progress &progress) const {
+  if (map == nullptr) {
+    return false;
+  }
+  madvise(map, map_bytes, MADV_WILLNEED);
+  size_t page = sysconf(_SC_PAGESIZE);
+  volatile uint8_t touched;
+  for (size_t done = 0; done < map_bytes;) {
+    size_t end = std::min<size_t>(done + WARM_CHUNK, map_bytes);
+    for (size_t p = done; p < end; p += page) {
+      touched = map[p];
+    }
+    done = end;
+    progress(done, map_bytes);
+  }
+  static_cast<void>(touched);
+  return true;
+}
+
+std::string mmap_store::get_song(std::array<unsigned char, 16> key) const {
+  auto it = songs.find(key);
+  return it == songs.end() ? "" : it->second;
+}
+
+std::string mmap_store::name() const { return "mmap"; }
+
+size_t mmap_store::memory_bytes() const { return map_bytes; }
+
+size_t mmap_store::num_keys() const { return header ? header->num_keys : 0; }
+
+size_t mmap_store::num_postings() const {
+  return header ? header->num_postings : 0;
+}
+
+size_t mmap_store::get_max_postings() const {
+  return header ? header->max_postings : 0;
+}
+
+bool mmap_store::is_stop_key(uint32_t key) const {
+  return header &&
+         std::binary_search(stop_keys, stop_keys + header->num_stop_keys, key);
+}
+
+std::vector<uint32_t> mmap_store::get_stop_keys() const {
+  if (!header) {
+    return {};
+  }
+  return std::vector<uint32_t>(stop_keys, stop_keys + header->num_stop_keys);
+}
+
+const std::map<std::array<unsigned char, 16>, std::string> &
+mmap_store::get_songs() const {
+  return songs;
+}
+
+// whether the song table names any of ids, such as the tombstoned songs
+// whose postings a merge has yet to drop
+bool mmap_store::holds_any_song(
+    const std::set<std::array<unsigned char, 16>> &ids) const {
+  for (const auto &s : songs) {
+    if (ids.find(s.first) != ids.end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// visit every list in key order
+void mmap_store::scan(
+    const std::function<void(uint32_t, posting_list)> &fn) const {
+  if (!header) {
+    return;
+  }
+  directory.scan([this, &fn](uint32_t key, uint64_t offset, uint32_t size) {
+    fn(key, {postings + offset, size});
+  });
+}
+
+void mmap_store::close() {
+  if (map) {
+    munmap(map, map_bytes);
+  }
+  map = nullptr;
+  map_bytes = 0;
+  header = nullptr;
+  stop_keys = nullptr;
+  postings = nullptr;
+  directory.clear();
+  songs.clear();
+}
@@ -0,0 +1,63 @@
+#ifndef _MMAP_STORE_H
+#define _MMAP_STORE_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "posting_store.hpp"
+#include "snapshot.hpp"
+#include "types.hpp"
+
+// read-only posting store that maps a snapshot file and searches its key
+// directory in place. the key table of a version 1 file is encoded into an
+// elias-fano directory in RAM when it is opened
+class mmap_store : public posting_store {
+  public:
+    mmap_store();
+    ~mmap_store();
+    bool open(const std::string &path, bool verify = false);
+    posting_list find(uint32_t key) const;
+    std::unique_ptr<posting_reader> reader() override;
+    size_t num_partitions() const override;
+    size_t partition_of(uint32_t key) const override;
+    bool scan_keys(const std::function<void(uint32_t)> &fn) const override;
+    bool warm_up(const warm_progress &progress) const override;
+    std::string get_song(std::array<unsigned char, 16> key) const override;
+    std::string name() const override;
+    size_t memory_bytes() const override;
+    size_t num_keys() const;
+    size_t num_postings() const;
+    size_t get_max_postings() const;
+    bool is_stop_key(uint32_t key) const;
+    std::vector<uint32_t> get_stop_keys() const;
+    const std::map<std::array<unsigned char, 16>, std::string> &
+    get_songs() const;
+    bool
+    holds_any_song(const std::set<std::array<unsigned char, 16>> &ids) const;
+    void scan(const std::function<void(uint32_t, posting_list)> &fn) const;
+
+  private:
+    void close();
+
+    uint8_t *map;
+    size_t map_bytes;
+    const snapshot_header *header;
+    const uint32_t *stop_keys;
+    key_directory directory;
+    const fp_data_t *postings;
+    std::map<std::array<unsigned char, 16>, std::string> songs;
+};
+
+#endif
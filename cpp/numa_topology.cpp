@@ -0,0 +1,71 @@
+#include "numa_topology.hpp"
+
+// has_memory leaves out nodes with only CPUs, which no page can be placed
+// on. kernels without it still list the online nodes
+numa_topology::numa_topology() {
+  const std::string sys = "/sys/devices/system/node/";
+  if (!read_list(sys + "has_memory", node_ids) &&
+      !read_list(sys + "online", node_ids)) {
+    node_ids.clear();
+  }
+  if (node_ids.empty()) {
+    node_ids.push_back(0);
+  }
+  for (int id : node_ids) {
+    std::vector<int> list;
+    read_list(sys + "node" + std::to_string(id) + "/cpulist", list);
+    node_cpus.push_back(list);
+  }
+}
+
+size_t numa_topology::num_nodes() const { return node_ids.size(); }
+
+int numa_topology::id(size_t node) const { return node_ids[node]; }
+
+const std::vector<int> &numa_topology::ids() const { return node_ids; }
+
+const std::vector<int> &numa_topology::cpus(size_t node) const {
+  return node_cpus[node];
+}
+
+// restrict the calling thread to the CPUs of node
+bool numa_topology::pin_thread(size_t node) const {
+  if (node >= node_cpus.size() || node_cpus[node].empty()) {
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : node_cpus[node]) {
+    CPU_SET(cpu, &set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// false if path cannot be read, an empty file is an empty list
+bool numa_topology::read_list(const std::string &path, std::vector<int> &list) {
+  std::ifstream f(path);
+  if (!f) {
+    return false;
+  }
+  std::string text;
+  f >> text;
+  list = parse_list(text);
+  return true;
+}
+
+// "0-3,8-11" style lists of CPUs or nodes
+std::vector<int> numa_topology::parse_list(const std::string &list) {
+  std::vector<int> values;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    size_t dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last =
+        dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int v = first; v <= last; ++v) {
+      values.push_back(v);
+    }
+  }
+  return values;
+}
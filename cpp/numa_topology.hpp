@@ -0,0 +1,33 @@
+#ifndef _NUMA_TOPOLOGY_H
+#define _NUMA_TOPOLOGY_H
+
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+// NUMA nodes of this machine holding memory and the CPUs belonging to each,
+// read from sysfs. node ids may have gaps and nodes may have no CPUs, nodes
+// are numbered 0..num_nodes()-1 here and id() gives the kernel's node id.
+// machines without the sysfs tree look like a single node
+class numa_topology {
+  public:
+    numa_topology();
+    size_t num_nodes() const;
+    int id(size_t node) const;
+    const std::vector<int> &ids() const;
+    const std::vector<int> &cpus(size_t node) const;
+    bool pin_thread(size_t node) const;
+
+  private:
+    static bool read_list(const std::string &path, std::vector<int> &list);
+    static std::vector<int> parse_list(const std::string &list);
+
+    std::vector<int> node_ids;
+    std::vector<std::vector<int>> node_cpus;
+};
+
+#endif
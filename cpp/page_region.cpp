@@ -0,0 +1,125 @@
+#include "page_region.hpp"
+
+page_region::page_region()
+    : addr(nullptr), bytes(0), map_bytes(0), actual(page_mode::normal) {}
+
+page_region::~page_region() { release(); }
+
+bool page_region::allocate(size_t bytes, page_mode mode) {
+  release();
+  this->bytes = bytes;
+  size_t rounded = (std::max<size_t>(bytes, 1) + HUGE_PAGE_BYTES - 1) &
+                   ~(HUGE_PAGE_BYTES - 1);
+
+  // explicit huge pages need pages reserved in vm.nr_hugepages
+  if (mode == page_mode::hugetlb) {
+    void *p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      addr = p;
+      map_bytes = rounded;
+      actual = page_mode::hugetlb;
+      return true;
+    }
+    mode = page_mode::transparent;
+  }
+
+  // over-allocate so the region can start on a huge page boundary, which
+  // lets transparent huge pages back all of it
+  size_t extra = mode == page_mode::transparent ? HUGE_PAGE_BYTES : 0;
+  void *p = mmap(nullptr, rounded + extra, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    this->bytes = 0;
+    return false;
+  }
+  uintptr_t start = reinterpret_cast<uintptr_t>(p);
+  uintptr_t aligned = start;
+  if (extra > 0) {
+    aligned = (start + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+    size_t tail = start + extra - aligned;
+    if (aligned > start) {
+      munmap(p, aligned - start);
+    }
+    if (tail > 0) {
+      munmap(reinterpret_cast<void *>(aligned + rounded), tail);
+    }
+  }
+  addr = reinterpret_cast<void *>(aligned);
+  map_bytes = rounded;
+
+  actual = page_mode::normal;
+  if (mode == page_mode::transparent &&
+      madvise(addr, map_bytes, MADV_HUGEPAGE) == 0) {
+    actual = page_mode::transparent;
+  }
+  return true;
+}
+
+// place every page of the region on the node with kernel id node, must
+// precede the first write
+bool page_region::bind_node(int node) {
+  return set_policy(MPOL_BIND, std::vector<int>(1, node));
+}
+
+// spread pages round robin over the nodes with the given kernel ids
+bool page_region::interleave(const std::vector<int> &nodes) {
+  return set_policy(MPOL_INTERLEAVE, nodes);
+}
+
+void *page_region::data() const { return addr; }
+
+size_t page_region::size() const { return bytes; }
+
+page_mode page_region::mode() const { return actual; }
+
+std::string page_region::mode_name(page_mode mode) {
+  switch (mode) {
+  case page_mode::transparent:
+    return "thp";
+  case page_mode::hugetlb:
+    return "hugetlb";
+  default:
+    return "normal";
+  }
+}
+
+bool page_region::parse_mode(const std::string &name, page_mode &mode) {
+  if (name == "normal") {
+    mode = page_mode::normal;
+  } else if (name == "thp") {
+    mode = page_mode::transparent;
+  } else if (name == "hugetlb") {
+    mode = page_mode::hugetlb;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void page_region::release() {
+  if (addr) {
+    munmap(addr, map_bytes);
+  }
+  addr = nullptr;
+  bytes = 0;
+  map_bytes = 0;
+  actual = page_mode::normal;
+}
+
+// glibc has no mbind wrapper without libnuma. the kernel drops the last
+// bit of maxnode, so it is passed as one more than the mask holds
+bool page_region::set_policy(int policy, const std::vector<int> &nodes) {
+  if (!addr || nodes.empty() ||
+      *std::min_element(nodes.begin(), nodes.end()) < 0) {
+    return false;
+  }
+  const size_t bits = 8 * sizeof(unsigned long);
+  std::vector<unsigned long> nodemask(
+      *std::max_element(nodes.begin(), nodes.end()) / bits + 1, 0);
+  for (int node : nodes) {
+    nodemask[node / bits] |= 1ul << (node % bits);
+  }
+  return syscall(SYS_mbind, addr, map_bytes, policy, nodemask.data(),
+                 nodemask.size() * bits + 1, 0) == 0;
+}
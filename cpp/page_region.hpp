@@ -0,0 +1,49 @@
+#ifndef _PAGE_REGION_H
+#define _PAGE_REGION_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// page size backing a large read-mostly array
+enum class page_mode { normal, transparent, hugetlb };
+
+// anonymous memory mapping whose page size and NUMA policy can be chosen.
+// huge pages that cannot be had fall back to the next smaller kind, so
+// mode() reports what the region actually uses
+class page_region {
+  public:
+    page_region();
+    ~page_region();
+    page_region(const page_region &) = delete;
+    page_region &operator=(const page_region &) = delete;
+
+    bool allocate(size_t bytes, page_mode mode);
+    bool bind_node(int node);
+    bool interleave(const std::vector<int> &nodes);
+    void *data() const;
+    size_t size() const;
+    page_mode mode() const;
+
+    static std::string mode_name(page_mode mode);
+    static bool parse_mode(const std::string &name, page_mode &mode);
+
+    static constexpr size_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+
+  private:
+    void release();
+    bool set_policy(int policy, const std::vector<int> &nodes);
+
+    void *addr;
+    size_t bytes;
+    size_t map_bytes;
+    page_mode actual;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "posting_cache.hpp"
+
+posting_cache::posting_cache(size_t capacity_bytes)
+    : shard_capacity(capacity_bytes / NUM_SHARDS), n_hits(0), n_misses(0) {}
+
+bool posting_cache::get(uint32_t key, std::vector<fp_data_t> &value) {
+  shard &s = shard_for(key);
+  std::lock_guard<std::mutex> lck(s.mtx);
+
+  auto it = s.index.find(key);
+  if (it == s.index.end()) {
+    ++n_misses;
+    return false;
+  }
+
+  // mark entry as recently used so the clock hand skips it once
+  entry &e = s.ring[it->second];
+  e.referenced = true;
+  value = e.value;
+  ++n_hits;
+  return true;
+}
+
+void posting_cache::put(uint32_t key, const std::vector<fp_data_t> &value) {
+  size_t nbytes = entry_bytes(value);
+
+  // lists larger than a whole shard are never cached
+  if (nbytes > shard_capacity) {
+    return;
+  }
+
+  shard &s = shard_for(key);
+  std::lock_guard<std::mutex> lck(s.mtx);
+
+  // replace existing entry in place
+  auto it = s.index.find(key);
+  if (it != s.index.end()) {
+    entry &e = s.ring[it->second];
+    s.bytes -= entry_bytes(e.value);
+    s.bytes += nbytes;
+    e.value = value;
+    e.referenced = true;
+  } else {
+    // make room for the new entry
+    while (!s.ring.empty() && s.bytes + nbytes > shard_capacity) {
+      evict_one(s);
+    }
+
+    s.index[key] = s.ring.size();
+    s.ring.push_back({key, false, value});
+    s.bytes += nbytes;
+  }
+}
+
+void posting_cache::erase(uint32_t key) {
+  shard &s = shard_for(key);
+  std::lock_guard<std::mutex> lck(s.mtx);
+
+  auto it = s.index.find(key);
+  if (it == s.index.end()) {
+    return;
+  }
+
+  // move the last entry into the freed slot
+  size_t slot = it->second;
+  s.bytes -= entry_bytes(s.ring[slot].value);
+  s.index.erase(it);
+  if (slot != s.ring.size() - 1) {
+    s.ring[slot] = std::move(s.ring.back());
+    s.index[s.ring[slot].key] = slot;
+  }
+  s.ring.pop_back();
+  if (s.hand >= s.ring.size()) {
+    s.hand = 0;
+  }
+}
+
+uint64_t posting_cache::hits() const { return n_hits; }
+
+uint64_t posting_cache::misses() const { return n_misses; }
+
+size_t posting_cache::size_bytes() {
+  size_t total = 0;
+  for (auto &s : shards) {
+    std::lock_guard<std::mutex> lck(s.mtx);
+    total += s.bytes;
+  }
+  return total;
+}
+
+// approximate memory used by one cached list, including bookkeeping so that
+// empty (negative) entries are not free
+size_t posting_cache::entry_bytes(const std::vector<fp_data_t> &value) {
+  return sizeof(entry) + 2 * sizeof(size_t) + sizeof(uint32_t) +
+         value.size() * sizeof(fp_data_t);
+}
+
+posting_cache::shard &posting_cache::shard_for(uint32_t key) {
+  // mix the key so neighbouring fingerprints spread over all shards
+  uint32_t h = key * 0x9e3779b1u;
+  return shards[(h >> 16) % NUM_SHARDS];
+}
+
+// advance the clock hand until an unreferenced entry is found and evict it
+void posting_cache::evict_one(shard &s) {
+  while (true) {
+    if (s.hand >= s.ring.size()) {
+      s.hand = 0;
+    }
+
+    entry &e = s.ring[s.hand];
+    if (e.referenced) {
+      e.referenced = false;
+      ++s.hand;
+      continue;
+    }
+
+    size_t slot = s.hand;
+    s.bytes -= entry_bytes(e.value);
+    s.index.erase(e.key);
+    if (slot != s.ring.size() - 1) {
+      s.ring[slot] = std::move(s.ring.back());
+      s.index[s.ring[slot].key] = slot;
+    }
+    s.ring.pop_back();
+    return;
+  }
+}
@@ -0,0 +1,52 @@
+#ifndef _POSTING_CACHE_H
+#define _POSTING_CACHE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "types.hpp"
+
+// byte-bounded cache of decoded posting lists, split into independently
+// locked shards and evicted with the CLOCK policy
+class posting_cache {
+  public:
+    posting_cache(size_t capacity_bytes);
+    bool get(uint32_t key, std::vector<fp_data_t> &value);
+    void put(uint32_t key, const std::vector<fp_data_t> &value);
+    void erase(uint32_t key);
+    uint64_t hits() const;
+    uint64_t misses() const;
+    size_t size_bytes();
+
+    static constexpr size_t NUM_SHARDS = 16;
+
+  private:
+    struct entry {
+      uint32_t key;
+      bool referenced;
+      std::vector<fp_data_t> value;
+    };
+
+    struct shard {
+      std::mutex mtx;
+      std::vector<entry> ring;
+      std::unordered_map<uint32_t, size_t> index;
+      size_t hand = 0;
+      size_t bytes = 0;
+    };
+
+    static size_t entry_bytes(const std::vector<fp_data_t> &value);
+    shard &shard_for(uint32_t key);
+    void evict_one(shard &s);
+
+    std::array<shard, NUM_SHARDS> shards;
+    size_t shard_capacity;
+    std::atomic<uint64_t> n_hits;
+    std::atomic<uint64_t> n_misses;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef _POSTING_STORE_H
+#define _POSTING_STORE_H
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+// progress of a warm-up, bytes done and bytes in total
+typedef std::function<void(uint64_t, uint64_t)> warm_progress;
+
+// warm-ups read and report in steps of this size
+static constexpr uint64_t WARM_CHUNK = 16 << 20;
+
+// contiguous run of postings returned by a lookup
+struct posting_list {
+  const fp_data_t *data;
+  size_t size;
+};
+
+// per-thread lookup state of a posting store, such as storage handles and
+// scratch space. a reader must only be used by one thread at a time, but
+// any number of readers may look up postings concurrently
+class posting_reader {
+  public:
+    virtual ~posting_reader() {}
+
+    // postings for key, valid until the next call on this reader
+    virtual posting_list find(uint32_t key) = 0;
+
+    // postings for n keys at once. fn(i, list) is called once for each
+    // key as its list becomes available, in any order, and the list is
+    // only valid during that call. stores that can overlap their reads
+    // override this, the default looks keys up one by one
+    virtual void
+    find_batch(const uint32_t *keys, size_t n,
+               const std::function<void(size_t, posting_list)> &fn) {
+      for (size_t i = 0; i < n; ++i) {
+        fn(i, find(keys[i]));
+      }
+    }
+};
+
+// reader for stores whose own lookups are already safe to share
+template <class T> class direct_reader : public posting_reader {
+  public:
+    direct_reader(const T &store) : store(store) {}
+    posting_list find(uint32_t key) override { return store.find(key); }
+
+  private:
+    const T &store;
+};
+
+// read side of a fingerprint index backend
+class posting_store {
+  public:
+    virtual ~posting_store() {}
+
+    // new reader for the calling thread
+    virtual std::unique_ptr<posting_reader> reader() = 0;
+
+    // pick up changes published since the store was opened. readers that
+    // already exist keep seeing the old index, returns true on a change
+    virtual bool refresh() { return false; }
+
+    // lookups in different partitions may run on different threads
+    virtual size_t num_partitions() const { return 1; }
+    virtual size_t partition_of(uint32_t key) const {
+      static_cast<void>(key);
+      return 0;
+    }
+
+    // call fn for every key with postings, possibly more than once for
+    // stores made of several parts. false if the store cannot list them
+    virtual bool scan_keys(const std::function<void(uint32_t)> &fn) const {
+      static_cast<void>(fn);
+      return false;
+    }
+
+    // read the whole index from disk into the page cache in order, so the
+    // first lookups after a start do not each wait on a random read.
+    // false if the store keeps nothing on disk to warm
+    virtual bool warm_up(const warm_progress &progress) const {
+      static_cast<void>(progress);
+      return false;
+    }
+
+    // song name if the store carries its own song table, "" otherwise
+    virtual std::string get_song(std::array<unsigned char, 16> key) const {
+      static_cast<void>(key);
+      return "";
+    }
+
+    virtual std::string name() const = 0;
+    virtual size_t memory_bytes() const { return 0; }
+    virtual std::string stats() const { return ""; }
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "probe_generator.hpp"
+
+probe_generator::probe_generator(int radius, int toggle_bits, size_t budget,
+                                 float max_cost)
+    : radius(std::max(0, std::min(radius, MASK_BITS))),
+      toggle_bits(std::max(0, std::min(toggle_bits, MASK_BITS))),
+      budget(budget), max_cost(max_cost) {}
+
+// append key and its neighbours to keys, likeliest first. with the bits
+// sorted by margin, every set is reached exactly once from the empty set
+// by adding the next bit after its last or moving its last bit on by one,
+// and neither step makes a set cheaper, so taking the cheapest set off a
+// heap yields all of them in order of cost
+void probe_generator::generate(uint32_t key, const bit_margins &margins,
+                               std::vector<uint32_t> &keys) {
+  size_t limit = budget == 0 ? static_cast<size_t>(-1) : budget;
+  keys.push_back(key);
+  if (limit == 1 || radius == 0 || toggle_bits == 0) {
+    return;
+  }
+
+  float sum = 0;
+  for (int i = 0; i < MASK_BITS; ++i) {
+    order[i] = i;
+    sum += margins[i];
+  }
+  std::sort(order.begin(), order.end(), [&margins](int a, int b) {
+    return margins[a] < margins[b];
+  });
+  float mean = sum / MASK_BITS;
+  float cutoff = max_cost > 0 && mean > 0 ? max_cost * mean : -1;
+
+  heap.clear();
+  heap.push_back({margins[order[0]], 1u << order[0], 0, 1});
+  for (size_t n = 1; n < limit && !heap.empty(); ++n) {
+    std::pop_heap(heap.begin(), heap.end(), cheaper_last);
+    node s = heap.back();
+    heap.pop_back();
+    if (cutoff >= 0 && s.cost > cutoff) {
+      break;
+    }
+    keys.push_back(key ^ s.flips);
+
+    int next = s.last + 1;
+    if (next >= toggle_bits) {
+      continue;
+    }
+    int bit = order[next];
+    if (s.size < radius) {
+      heap.push_back(
+          {s.cost + margins[bit], s.flips | 1u << bit, next, s.size + 1});
+      std::push_heap(heap.begin(), heap.end(), cheaper_last);
+    }
+    int last_bit = order[s.last];
+    heap.push_back({s.cost - margins[last_bit] + margins[bit],
+                    (s.flips & ~(1u << last_bit)) | 1u << bit, next,
+                    s.size});
+    std::push_heap(heap.begin(), heap.end(), cheaper_last);
+  }
+}
+
+int probe_generator::get_radius() const { return radius; }
+
+int probe_generator::get_toggle_bits() const { return toggle_bits; }
+
+size_t probe_generator::get_budget() const { return budget; }
+
+float probe_generator::get_max_cost() const { return max_cost; }
+
+// heap order putting the cheapest set on top
+bool probe_generator::cheaper_last(const node &a, const node &b) {
+  return a.cost > b.cost;
+}
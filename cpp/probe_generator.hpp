@@ -0,0 +1,50 @@
+#ifndef _PROBE_GENERATOR_H
+#define _PROBE_GENERATOR_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "types.hpp"
+
+// neighbours of a fingerprint in decreasing likelihood. bits are taken to
+// flip independently, a bit the less likely the larger its margin, so a
+// set of flipped bits costs the sum of their margins and the cheapest sets
+// come first. only the toggle_bits least reliable bits are flipped, at
+// most radius of them at once, as with TOGGLE_BITS in the python tool.
+// generation stops after budget keys or at the first set costing more
+// than max_cost mean margins of the fingerprint, 0 disables either limit
+class probe_generator {
+  public:
+    probe_generator(int radius, int toggle_bits = MASK_BITS,
+                    size_t budget = 0, float max_cost = 0);
+    void generate(uint32_t key, const bit_margins &margins,
+                  std::vector<uint32_t> &keys);
+    int get_radius() const;
+    int get_toggle_bits() const;
+    size_t get_budget() const;
+    float get_max_cost() const;
+
+  private:
+    // a set of flipped bits, last is the position in order of its least
+    // reliable bit
+    struct node {
+      float cost;
+      uint32_t flips;
+      int last;
+      int size;
+    };
+
+    static bool cheaper_last(const node &a, const node &b);
+
+    int radius;
+    int toggle_bits;
+    size_t budget;
+    float max_cost;
+    std::array<int, MASK_BITS> order;
+    std::vector<node> heap;
+};
+
+#endif
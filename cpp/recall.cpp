@@ -0,0 +1,164 @@
+#include "recall.hpp"
+
+void print_usage(const char *name) {
+  std::cout << "Usage: " << name
+            << " [-n snr_db] [-R radius] [-K bits] [-L cost] [-x seed] "
+               "path/to/audio..."
+            << std::endl;
+  std::cout << "  -n  signal to noise ratio of the noisy copy in dB, "
+               "default 10"
+            << std::endl;
+  std::cout << "  -R  largest number of bits flipped by a probe, default 2"
+            << std::endl;
+  std::cout << "  -K  only flip this many least reliable bits, default all "
+            << MASK_BITS << std::endl;
+  std::cout << "  -L  skip probes costing more than this many mean margins"
+            << std::endl;
+  std::cout << "  -x  seed of the noise" << std::endl;
+}
+
+// white noise at snr_db below the power of data
+std::vector<double> add_noise(const std::vector<double> &data, double snr_db,
+                              std::mt19937 &rng) {
+  double power = 0;
+  for (double x : data) {
+    power += x * x;
+  }
+  power /= std::max<size_t>(data.size(), 1);
+  std::normal_distribution<double> noise(
+      0, std::sqrt(power / std::pow(10, snr_db / 10)));
+
+  std::vector<double> noisy(data);
+  for (double &x : noisy) {
+    x += noise(rng);
+  }
+  return noisy;
+}
+
+// position of target among the probes, past every budget if missing
+size_t rank_of(const std::vector<uint32_t> &keys, uint32_t target) {
+  auto it = std::find(keys.begin(), keys.end(), target);
+  return it == keys.end() ? static_cast<size_t>(-1) : it - keys.begin();
+}
+
+// fingerprint data and a noisy copy of it. a noisy fingerprint at the same
+// frame and band as a clean one should find the clean key, rank where it
+// comes among the probes, likeliest first and in plain enumeration order
+void count_recall(const std::vector<double> &data, double snr_db,
+                  probe_generator &generator, std::mt19937 &rng,
+                  recall_counts &counts) {
+  fingerprint fp;
+  std::map<std::pair<int32_t, uint32_t>, uint32_t> clean;
+  for (const auto &f : fp.get_fingerprints(data)) {
+    clean[{f.t, band_of(f.fp)}] = f.fp;
+  }
+
+  std::vector<bit_margins> margins;
+  auto noisy = fp.get_fingerprints(add_noise(data, snr_db, rng), &margins);
+  counts.fingerprints += noisy.size();
+
+  std::vector<uint32_t> keys;
+  for (size_t i = 0; i < noisy.size(); ++i) {
+    auto it = clean.find({noisy[i].t, band_of(noisy[i].fp)});
+    if (it == clean.end()) {
+      continue;
+    }
+    uint32_t target = it->second;
+    ++counts.pairs;
+    ++counts.distances[__builtin_popcount(target ^ noisy[i].fp)];
+
+    keys.clear();
+    generator.generate(noisy[i].fp, margins[i], keys);
+    size_t rank = rank_of(keys, target);
+    for (size_t b = 0; b < RECALL_BUDGETS.size(); ++b) {
+      counts.ordered[b] += rank < RECALL_BUDGETS[b];
+      counts.ordered_probes[b] += std::min(keys.size(), RECALL_BUDGETS[b]);
+    }
+
+    keys.clear();
+    hamming_index::enumerate(noisy[i].fp, generator.get_radius(), keys);
+    rank = rank_of(keys, target);
+    for (size_t b = 0; b < RECALL_BUDGETS.size(); ++b) {
+      counts.enumerated[b] += rank < RECALL_BUDGETS[b];
+    }
+  }
+}
+
+void print_recall(const recall_counts &counts) {
+  double pairs = std::max<uint64_t>(counts.pairs, 1);
+  std::cout << counts.fingerprints << " noisy fingerprints, " << counts.pairs
+            << " at the frame and band of a clean one" << std::endl;
+
+  std::cout << "hamming distance to the clean key:";
+  uint64_t beyond = 0;
+  for (size_t d = 0; d < counts.distances.size(); ++d) {
+    if (d <= 3) {
+      std::cout << " " << d << ": " << std::fixed << std::setprecision(1)
+                << 100 * counts.distances[d] / pairs << "%";
+    } else {
+      beyond += counts.distances[d];
+    }
+  }
+  std::cout << " 4+: " << 100 * beyond / pairs << "%" << std::endl;
+
+  std::cout << "budget  likeliest first  (mean probes)  enumerated"
+            << std::endl;
+  for (size_t b = 0; b < RECALL_BUDGETS.size(); ++b) {
+    std::cout << std::setw(6) << RECALL_BUDGETS[b] << std::setw(16)
+              << 100 * counts.ordered[b] / pairs << "%" << std::setw(15)
+              << counts.ordered_probes[b] / pairs << std::setw(11)
+              << 100 * counts.enumerated[b] / pairs << "%" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  // parse options
+  double snr_db = 10;
+  int radius = 2;
+  int toggle_bits = MASK_BITS;
+  float max_cost = 0;
+  unsigned seed = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:R:K:L:x:")) != -1) {
+    switch (opt) {
+    case 'n':
+      snr_db = std::stod(optarg);
+      break;
+    case 'R':
+      radius = std::stoi(optarg);
+      break;
+    case 'K':
+      toggle_bits = std::stoi(optarg);
+      break;
+    case 'L':
+      max_cost = std::stof(optarg);
+      break;
+    case 'x':
+      seed = std::stoul(optarg);
+      break;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind >= argc) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  probe_generator generator(radius, toggle_bits, RECALL_BUDGETS.back(),
+                            max_cost);
+  std::mt19937 rng(seed);
+  recall_counts counts;
+  audio_helper ah;
+  for (int i = optind; i < argc; ++i) {
+    auto data = ah.read_from_file(argv[i]);
+    if (data.size() == 0) {
+      std::cerr << "Bad file \"" << argv[i] << "\"" << std::endl;
+      continue;
+    }
+    count_recall(data, snr_db, generator, rng, counts);
+  }
+  print_recall(counts);
+  return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef _RECALL_H
+#define _RECALL_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include "audio_helper.hpp"
+#include "fingerprint.hpp"
+#include "hamming_index.hpp"
+#include "probe_generator.hpp"
+#include "types.hpp"
+
+// probe budgets compared, 254 is every key within hamming distance 2
+static constexpr std::array<size_t, 6> RECALL_BUDGETS = {
+    {1, 16, 32, 64, 128, 254}};
+
+// how often a fingerprint of the noisy copy reached the key its clean
+// counterpart was stored under, within each budget
+struct recall_counts {
+  uint64_t fingerprints = 0;
+  uint64_t pairs = 0;
+  std::array<uint64_t, MASK_BITS + 1> distances{};
+  std::array<uint64_t, RECALL_BUDGETS.size()> ordered{};
+  std::array<uint64_t, RECALL_BUDGETS.size()> ordered_probes{};
+  std::array<uint64_t, RECALL_BUDGETS.size()> enumerated{};
+};
+
+std::vector<double> add_noise(const std::vector<double> &data, double snr_db,
+                              std::mt19937 &rng);
+size_t rank_of(const std::vector<uint32_t> &keys, uint32_t target);
+void count_recall(const std::vector<double> &data, double snr_db,
+                  probe_generator &generator, std::mt19937 &rng,
+                  recall_counts &counts);
+void print_recall(const recall_counts &counts);
+
+#endif
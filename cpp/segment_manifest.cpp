@@ -0,0 +1,87 @@
+#include "segment_manifest.hpp"
+
+segment_manifest::segment_manifest() : next_seq(0) {}
+
+bool segment_manifest::read(const std::string &dir) {
+  std::ifstream f(path(dir));
+  if (f.fail()) {
+    return false;
+  }
+
+  std::string tag;
+  f >> tag >> next_seq;
+  if (f.fail() || tag != "next") {
+    return false;
+  }
+
+  segments.clear();
+  std::string name;
+  while (f >> name) {
+    segments.push_back(name);
+  }
+  return true;
+}
+
+// write the new list beside the old one, then swap it in atomically
+bool segment_manifest::write(const std::string &dir) const {
+  std::string temp_path = path(dir) + ".tmp";
+  {
+    std::ofstream f(temp_path, std::ios::trunc);
+    f << "next " << next_seq << "\n";
+    for (const auto &name : segments) {
+      f << name << "\n";
+    }
+    f.close();
+    if (f.fail()) {
+      return false;
+    }
+  }
+
+  return sync_file(temp_path) &&
+         std::rename(temp_path.c_str(), path(dir).c_str()) == 0;
+}
+
+// reserve the file name of a new segment
+std::string segment_manifest::new_segment() {
+  char name[32];
+  std::snprintf(name, sizeof(name), "seg-%06llu.snap",
+                static_cast<unsigned long long>(next_seq++));
+  return name;
+}
+
+std::string segment_manifest::path(const std::string &dir) {
+  return dir + "/MANIFEST";
+}
+
+std::string segment_manifest::segment_path(const std::string &dir,
+                                           const std::string &name) {
+  return dir + "/" + name;
+}
+
+// flush a file to disk before it is published
+bool segment_manifest::sync_file(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = fsync(fd) == 0;
+  close(fd);
+  return ok;
+}
+
+manifest_lock::manifest_lock(const std::string &dir) {
+  fd = open((dir + "/LOCK").c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd >= 0 && flock(fd, LOCK_EX) != 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+manifest_lock::~manifest_lock() {
+  if (fd >= 0) {
+    flock(fd, LOCK_UN);
+    close(fd);
+  }
+}
+
+bool manifest_lock::locked() const { return fd >= 0; }
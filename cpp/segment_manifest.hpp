@@ -0,0 +1,48 @@
+#ifndef _SEGMENT_MANIFEST_H
+#define _SEGMENT_MANIFEST_H
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// list of the live segments of a segmented index. a segment is an
+// immutable snapshot file in the index directory, the manifest is only
+// ever replaced by rename so readers always see a complete list:
+//
+//   next <sequence number of the next segment>
+//   <segment file name>
+//   ..
+class segment_manifest {
+  public:
+    segment_manifest();
+    bool read(const std::string &dir);
+    bool write(const std::string &dir) const;
+    std::string new_segment();
+
+    static std::string path(const std::string &dir);
+    static std::string segment_path(const std::string &dir,
+                                    const std::string &name);
+    static bool sync_file(const std::string &path);
+
+    uint64_t next_seq;
+    std::vector<std::string> segments;
+};
+
+// exclusive lock serialising manifest updates between processes
+class manifest_lock {
+  public:
+    manifest_lock(const std::string &dir);
+    ~manifest_lock();
+    bool locked() const;
+
+  private:
+    int fd;
+};
+
+#endif
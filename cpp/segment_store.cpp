@@ -0,0 +1,162 @@
+#include "segment_store.hpp"
+
+// manifest updates are attempted again if a merge removes a segment
+// between reading the list and mapping its files
+static constexpr int REFRESH_ATTEMPTS = 8;
+
+segment_reader::segment_reader(std::shared_ptr<const segment_list> segments)
+    : segments(std::move(segments)) {}
+
+posting_list segment_reader::find(uint32_t key) {
+  // a stop key in any segment is a stop key of the whole index
+  lists.clear();
+  for (const auto &seg : *segments) {
+    if (seg->store.is_stop_key(key)) {
+      return {nullptr, 0};
+    }
+    auto list = seg->store.find(key);
+    if (list.size > 0) {
+      lists.push_back(list);
+    }
+  }
+
+  // lists found in a single segment are returned in place
+  if (lists.empty()) {
+    return {nullptr, 0};
+  } else if (lists.size() == 1) {
+    return lists[0];
+  }
+
+  scratch.clear();
+  for (const auto &list : lists) {
+    scratch.insert(scratch.end(), list.data, list.data + list.size);
+  }
+  return {scratch.data(), scratch.size()};
+}
+
+segment_store::segment_store() : segments(new segment_list()) {
+  std::memset(&manifest_stat, 0, sizeof(manifest_stat));
+}
+
+bool segment_store::open(const std::string &dir) {
+  this->dir = dir;
+  return refresh();
+}
+
+std::unique_ptr<posting_reader> segment_store::reader() {
+  return std::unique_ptr<posting_reader>(new segment_reader(current()));
+}
+
+bool segment_store::refresh() {
+  std::lock_guard<std::mutex> lck(refresh_mtx);
+
+  for (int attempt = 0; attempt < REFRESH_ATTEMPTS; ++attempt) {
+    // every update renames a new manifest into place
+    struct stat st;
+    if (stat(segment_manifest::path(dir).c_str(), &st) != 0 ||
+        (st.st_ino == manifest_stat.st_ino &&
+         st.st_size == manifest_stat.st_size &&
+         st.st_mtim.tv_sec == manifest_stat.st_mtim.tv_sec &&
+         st.st_mtim.tv_nsec == manifest_stat.st_mtim.tv_nsec)) {
+      return false;
+    }
+
+    segment_manifest manifest;
+    if (!manifest.read(dir)) {
+      continue;
+    }
+
+    // keep segments that are still listed, map the new ones
+    auto old_segments = current();
+    std::map<std::string, std::shared_ptr<const segment>> by_name;
+    for (const auto &seg : *old_segments) {
+      by_name[seg->name] = seg;
+    }
+    std::shared_ptr<segment_list> next(new segment_list());
+    bool complete = true;
+    for (const auto &name : manifest.segments) {
+      auto it = by_name.find(name);
+      if (it != by_name.end()) {
+        next->push_back(it->second);
+        continue;
+      }
+      std::shared_ptr<segment> seg(new segment());
+      seg->name = name;
+      if (!seg->store.open(segment_manifest::segment_path(dir, name))) {
+        complete = false;
+        break;
+      }
+      next->push_back(seg);
+    }
+    if (!complete) {
+      continue;
+    }
+
+    // readers created from now on see the new list
+    std::lock_guard<std::mutex> swap_lck(mtx);
+    segments = next;
+    manifest_stat = st;
+    return true;
+  }
+
+  std::cerr << "Error: could not load segments in " << dir << std::endl;
+  return false;
+}
+
+// keys held by several segments are visited once per segment
+bool segment_store::scan_keys(
+    const std::function<void(uint32_t)> &fn) const {
+  auto segments = current();
+  for (const auto &seg : *segments) {
+    seg->store.scan_keys(fn);
+  }
+  return true;
+}
+
+// warm the segments one after another, progress covers all of them
+bool segment_store::warm_up(const warm_progress &progress) const {
+  auto segments = current();
+  uint64_t total = 0;
+  for (const auto &seg : *segments) {
+    total += seg->store.memory_bytes();
+  }
+  uint64_t before = 0;
+  for (const auto &seg : *segments) {
+    seg->store.warm_up([&progress, before, total](uint64_t done, uint64_t) {
+      progress(before + done, total);
+    });
+    before += seg->store.memory_bytes();
+  }
+  return true;
+}
+
+std::string segment_store::get_song(std::array<unsigned char, 16> key) const {
+  for (const auto &seg : *current()) {
+    auto name = seg->store.get_song(key);
+    if (name != "") {
+      return name;
+    }
+  }
+  return "";
+}
+
+std::string segment_store::name() const { return "segments"; }
+
+size_t segment_store::memory_bytes() const {
+  size_t bytes = 0;
+  for (const auto &seg : *current()) {
+    bytes += seg->store.memory_bytes();
+  }
+  return bytes;
+}
+
+std::string segment_store::stats() const {
+  return std::to_string(num_segments()) + " segments";
+}
+
+size_t segment_store::num_segments() const { return current()->size(); }
+
+std::shared_ptr<const segment_list> segment_store::current() const {
+  std::lock_guard<std::mutex> lck(mtx);
+  return segments;
+}
@@ -0,0 +1,67 @@
+#ifndef _SEGMENT_STORE_H
+#define _SEGMENT_STORE_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "mmap_store.hpp"
+#include "posting_store.hpp"
+#include "segment_manifest.hpp"
+#include "types.hpp"
+
+// one mapped segment, kept alive while any reader still uses it
+struct segment {
+  std::string name;
+  mmap_store store;
+};
+
+typedef std::vector<std::shared_ptr<const segment>> segment_list;
+
+// union of the segments listed in one version of the manifest
+class segment_reader : public posting_reader {
+  public:
+    segment_reader(std::shared_ptr<const segment_list> segments);
+    posting_list find(uint32_t key) override;
+
+  private:
+    std::shared_ptr<const segment_list> segments;
+    std::vector<posting_list> lists;
+    std::vector<fp_data_t> scratch;
+};
+
+// posting store over the immutable segments of a segment directory.
+// ingest and the merger only ever add files and swap the manifest, so
+// each reader works on a fixed set of segments and never waits on them
+class segment_store : public posting_store {
+  public:
+    segment_store();
+    bool open(const std::string &dir);
+    std::unique_ptr<posting_reader> reader() override;
+    bool refresh() override;
+    bool scan_keys(const std::function<void(uint32_t)> &fn) const override;
+    bool warm_up(const warm_progress &progress) const override;
+    std::string get_song(std::array<unsigned char, 16> key) const override;
+    std::string name() const override;
+    size_t memory_bytes() const override;
+    std::string stats() const override;
+    size_t num_segments() const;
+
+  private:
+    std::shared_ptr<const segment_list> current() const;
+
+    std::string dir;
+    struct stat manifest_stat;
+    std::mutex refresh_mtx;
+    mutable std::mutex mtx;
+    std::shared_ptr<const segment_list> segments;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include "sharded_database.hpp"
+
+sharded_database::sharded_database(const std::string filename,
+                                   size_t num_shards, size_t cache_bytes) {
+  // use the layout already on disk unless told otherwise
+  if (num_shards == 0) {
+    num_shards = std::max<size_t>(count_shards(filename), 1);
+  }
+
+  for (size_t i = 0; i < num_shards; ++i) {
+    shards.emplace_back(new database(shard_path(filename, i, num_shards),
+                                     cache_bytes / num_shards));
+  }
+}
+
+size_t sharded_database::num_shards() const { return shards.size(); }
+
+size_t sharded_database::shard_of(uint32_t key) const {
+  return shard_of(key, shards.size());
+}
+
+database &sharded_database::shard(size_t idx) { return *shards[idx]; }
+
+std::vector<fp_data_t> sharded_database::get_fp(uint32_t key) {
+  return shards[shard_of(key)]->get_fp(key);
+}
+
+void sharded_database::put_fp(uint32_t key, const fp_data_t &value) {
+  shards[shard_of(key)]->put_fp(key, value);
+}
+
+// hand every shard its part of the lists, keeping their order
+void sharded_database::append_fp_lists(
+    const std::vector<std::pair<uint32_t, std::vector<fp_data_t>>> &lists) {
+  std::vector<std::vector<std::pair<uint32_t, std::vector<fp_data_t>>>>
+      shard_lists(shards.size());
+  for (const auto &l : lists) {
+    shard_lists[shard_of(l.first)].push_back(l);
+  }
+  for (size_t i = 0; i < shards.size(); ++i) {
+    shards[i]->append_fp_lists(shard_lists[i]);
+  }
+}
+
+void sharded_database::set_max_postings(size_t max_postings) {
+  for (auto &s : shards) {
+    s->set_max_postings(max_postings);
+  }
+}
+
+void sharded_database::set_bucket_bits(size_t bucket_bits) {
+  for (auto &s : shards) {
+    s->set_bucket_bits(bucket_bits);
+  }
+}
+
+size_t sharded_database::get_bucket_bits() const {
+  return shards[0]->get_bucket_bits();
+}
+
+// counters summed over the shards, false if any shard is uncounted
+bool sharded_database::get_stats(catalogue_stats &stats) const {
+  stats = {0, 0, 0, 0};
+  for (const auto &s : shards) {
+    catalogue_stats shard_stats;
+    if (!s->get_stats(shard_stats)) {
+      return false;
+    }
+    stats.songs += shard_stats.songs;
+    stats.keys += shard_stats.keys;
+    stats.postings += shard_stats.postings;
+    stats.bytes += shard_stats.bytes;
+  }
+  return true;
+}
+
+// commit every shard, false if any could not be written
+bool sharded_database::commit() {
+  bool ok = true;
+  for (auto &s : shards) {
+    ok = s->commit() && ok;
+  }
+  return ok;
+}
+
+uint64_t sharded_database::cache_hits() const {
+  uint64_t total = 0;
+  for (const auto &s : shards) {
+    total += s->cache_hits();
+  }
+  return total;
+}
+
+uint64_t sharded_database::cache_misses() const {
+  uint64_t total = 0;
+  for (const auto &s : shards) {
+    total += s->cache_misses();
+  }
+  return total;
+}
+
+// a single shard keeps the plain file name, otherwise the shard number is
+// inserted before the extension, e.g. fingerprints.3.db
+std::string sharded_database::shard_path(const std::string &filename,
+                                         size_t idx, size_t num_shards) {
+  if (num_shards == 1) {
+    return filename;
+  }
+
+  size_t dot_idx = filename.find_last_of('.');
+  size_t slash_idx = filename.find_last_of('/');
+  if (dot_idx == std::string::npos ||
+      (slash_idx != std::string::npos && dot_idx < slash_idx)) {
+    return filename + "." + std::to_string(idx);
+  }
+  return filename.substr(0, dot_idx) + "." + std::to_string(idx) +
+         filename.substr(dot_idx);
+}
+
+// number of shard files present on disk, 0 if there is no index yet
+size_t sharded_database::count_shards(const std::string &filename) {
+  size_t n = 0;
+  while (access(shard_path(filename, n, 2).c_str(), F_OK) == 0) {
+    ++n;
+  }
+  if (n == 0 && access(filename.c_str(), F_OK) == 0) {
+    n = 1;
+  }
+  return n;
+}
+
+size_t sharded_database::shard_of(uint32_t key, size_t num_shards) {
+  // mix the key so that every band is spread over all shards
+  uint32_t h = key * 0x9e3779b1u;
+  return (h >> 8) % num_shards;
+}
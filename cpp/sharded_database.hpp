@@ -0,0 +1,45 @@
+#ifndef _SHARDED_DATABASE_H
+#define _SHARDED_DATABASE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "database.hpp"
+#include "types.hpp"
+
+// fingerprint index partitioned by key hash over several database files
+class sharded_database {
+  public:
+    sharded_database(const std::string filename, size_t num_shards = 0,
+                     size_t cache_bytes = 0);
+    size_t num_shards() const;
+    size_t shard_of(uint32_t key) const;
+    database &shard(size_t idx);
+    std::vector<fp_data_t> get_fp(uint32_t key);
+    void put_fp(uint32_t key, const fp_data_t &value);
+    void append_fp_lists(
+        const std::vector<std::pair<uint32_t, std::vector<fp_data_t>>>
+            &lists);
+    void set_max_postings(size_t max_postings);
+    void set_bucket_bits(size_t bucket_bits);
+    size_t get_bucket_bits() const;
+    bool get_stats(catalogue_stats &stats) const;
+    bool commit();
+    uint64_t cache_hits() const;
+    uint64_t cache_misses() const;
+
+    static std::string shard_path(const std::string &filename, size_t idx,
+                                  size_t num_shards);
+    static size_t count_shards(const std::string &filename);
+    static size_t shard_of(uint32_t key, size_t num_shards);
+
+  private:
+    std::vector<std::unique_ptr<database>> shards;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include "shared_index.hpp"
+
+shared_index_reader::shared_index_reader(
+    std::shared_ptr<const mmap_store> store)
+    : store(std::move(store)) {}
+
+posting_list shared_index_reader::find(uint32_t key) {
+  return store->find(key);
+}
+
+shared_index::shared_index() : verify(false), store(new mmap_store()) {
+  std::memset(&file_stat, 0, sizeof(file_stat));
+}
+
+bool shared_index::open(const std::string &path, bool verify) {
+  this->path = path;
+  this->verify = verify;
+  return refresh();
+}
+
+std::unique_ptr<posting_reader> shared_index::reader() {
+  return std::unique_ptr<posting_reader>(new shared_index_reader(current()));
+}
+
+bool shared_index::refresh() {
+  std::lock_guard<std::mutex> lck(refresh_mtx);
+
+  // publishing renames a new file into place. the inode of the mapped
+  // file stays in use, so the new one always has a different number
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || (st.st_ino == file_stat.st_ino &&
+                                       st.st_dev == file_stat.st_dev &&
+                                       st.st_size == file_stat.st_size)) {
+    return false;
+  }
+  file_stat = st;
+
+  std::shared_ptr<mmap_store> next(new mmap_store());
+  if (!next->open(path, verify)) {
+    std::cerr << "Error: bad snapshot " << path << std::endl;
+    return false;
+  }
+
+  // the old mapping goes away with its last reader
+  std::lock_guard<std::mutex> swap_lck(mtx);
+  store = next;
+  return true;
+}
+
+// every version of the snapshot is split into the same bands
+size_t shared_index::num_partitions() const { return MAX_BANDS; }
+
+size_t shared_index::partition_of(uint32_t key) const { return band_of(key); }
+
+bool shared_index::scan_keys(
+    const std::function<void(uint32_t)> &fn) const {
+  return current()->scan_keys(fn);
+}
+
+bool shared_index::warm_up(const warm_progress &progress) const {
+  return current()->warm_up(progress);
+}
+
+std::string shared_index::get_song(std::array<unsigned char, 16> key) const {
+  return current()->get_song(key);
+}
+
+std::string shared_index::name() const { return "mmap"; }
+
+size_t shared_index::memory_bytes() const {
+  return current()->memory_bytes();
+}
+
+size_t shared_index::num_keys() const { return current()->num_keys(); }
+
+size_t shared_index::num_postings() const {
+  return current()->num_postings();
+}
+
+std::shared_ptr<const mmap_store> shared_index::current() const {
+  std::lock_guard<std::mutex> lck(mtx);
+  return store;
+}
@@ -0,0 +1,58 @@
+#ifndef _SHARED_INDEX_H
+#define _SHARED_INDEX_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+
+#include "mmap_store.hpp"
+#include "posting_store.hpp"
+#include "types.hpp"
+
+// reader pinned to one version of the mapped snapshot
+class shared_index_reader : public posting_reader {
+  public:
+    shared_index_reader(std::shared_ptr<const mmap_store> store);
+    posting_list find(uint32_t key) override;
+
+  private:
+    std::shared_ptr<const mmap_store> store;
+};
+
+// snapshot mapped read-only by any number of processes, which all share
+// its pages in the page cache. a new snapshot is published by renaming it
+// over the old path, refresh() then maps the new file while readers of
+// the old one finish on the old mapping
+class shared_index : public posting_store {
+  public:
+    shared_index();
+    bool open(const std::string &path, bool verify = false);
+    std::unique_ptr<posting_reader> reader() override;
+    bool refresh() override;
+    size_t num_partitions() const override;
+    size_t partition_of(uint32_t key) const override;
+    bool scan_keys(const std::function<void(uint32_t)> &fn) const override;
+    bool warm_up(const warm_progress &progress) const override;
+    std::string get_song(std::array<unsigned char, 16> key) const override;
+    std::string name() const override;
+    size_t memory_bytes() const override;
+    size_t num_keys() const;
+    size_t num_postings() const;
+
+  private:
+    std::shared_ptr<const mmap_store> current() const;
+
+    std::string path;
+    bool verify;
+    struct stat file_stat;
+    std::mutex refresh_mtx;
+    mutable std::mutex mtx;
+    std::shared_ptr<const mmap_store> store;
+};
+
+#endif
@@ -0,0 +1,470 @@
+#include "snapshot.hpp"
+
+static constexpr size_t CHUNK_BYTES = 64 * 1024 * 1024;
+static constexpr size_t BUDGET_CHUNK_BYTES = 1024 * 1024;
+static constexpr size_t IMPORT_CHUNK = 65536;
+
+static size_t align8(size_t n) { return (n + 7) & ~static_cast<size_t>(7); }
+
+snapshot_hasher::snapshot_hasher()
+    : h(0xcbf29ce484222325ull), carry(0), carry_bytes(0) {}
+
+void snapshot_hasher::update(const void *data, size_t n) {
+  auto p = static_cast<const uint8_t *>(data);
+
+  // finish a word left over from the previous call
+  while (carry_bytes > 0 && n > 0) {
+    carry |= static_cast<uint64_t>(*p++) << (8 * carry_bytes);
+    --n;
+    if (++carry_bytes == 8) {
+      mix(carry);
+      carry = 0;
+      carry_bytes = 0;
+    }
+  }
+
+  // bulk of the input a word at a time
+  for (; n >= 8; n -= 8, p += 8) {
+    uint64_t word;
+    std::memcpy(&word, p, 8);
+    mix(word);
+  }
+
+  for (; n > 0; --n) {
+    carry |= static_cast<uint64_t>(*p++) << (8 * carry_bytes++);
+  }
+}
+
+uint64_t snapshot_hasher::digest() const {
+  uint64_t d = h;
+  if (carry_bytes > 0) {
+    d = (d ^ carry ^ (static_cast<uint64_t>(carry_bytes) << 56)) *
+        0x100000001b3ull;
+  }
+  return d ^ (d >> 29);
+}
+
+void snapshot_hasher::mix(uint64_t word) {
+  h = (h ^ word) * 0x100000001b3ull;
+  h ^= h >> 32;
+}
+
+io_budget::io_budget(size_t bytes_per_sec)
+    : bytes_per_sec(bytes_per_sec), spent(0),
+      start(std::chrono::steady_clock::now()) {}
+
+void io_budget::spend(size_t bytes) {
+  if (bytes_per_sec == 0) {
+    return;
+  }
+
+  // sleep until the bytes spent so far fit the rate
+  spent += bytes;
+  auto due = start + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::duration<double>(
+                             static_cast<double>(spent) / bytes_per_sec));
+  std::this_thread::sleep_until(due);
+}
+
+// false if the lists are not back to back in key order
+bool key_directory::build(const snapshot_key *keys, size_t n,
+                          uint64_t num_postings) {
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t end = i + 1 < n ? keys[i + 1].offset : num_postings;
+    if ((i > 0 && keys[i].key <= keys[i - 1].key) ||
+        keys[i].offset + keys[i].size != end) {
+      return false;
+    }
+  }
+
+  storage.clear();
+  this->keys.build(n, [keys](size_t i) { return keys[i].key; });
+  offsets.build(n + 1, [keys, n, num_postings](size_t i) {
+    return i < n ? keys[i].offset : num_postings;
+  });
+  return true;
+}
+
+// keys and then offsets, as written by write(). offsets never decrease, so
+// lists end within the postings if the last offset is num_postings
+bool key_directory::attach(const uint64_t *words, size_t n_words,
+                           uint64_t num_postings) {
+  if (!keys.attach(words, n_words) ||
+      !offsets.attach(words + keys.num_words(), n_words - keys.num_words()) ||
+      offsets.size() != keys.size() + 1 ||
+      offsets.get(keys.size()) != num_postings) {
+    clear();
+    return false;
+  }
+  return true;
+}
+
+// like attach, keeping the words
+bool key_directory::read(std::vector<uint64_t> &&words,
+                         uint64_t num_postings) {
+  storage.swap(words);
+  return attach(storage.data(), storage.size(), num_postings);
+}
+
+void key_directory::clear() {
+  keys.clear();
+  offsets.clear();
+  storage.clear();
+}
+
+bool key_directory::find(uint32_t key, uint64_t &offset,
+                         uint32_t &size) const {
+  size_t i = keys.find(key);
+  if (i == elias_fano::NOT_FOUND) {
+    return false;
+  }
+  uint64_t end;
+  offsets.get_pair(i, offset, end);
+  size = end - offset;
+  return true;
+}
+
+// visit every key with its list in key order
+void key_directory::scan(
+    const std::function<void(uint32_t, uint64_t, uint32_t)> &fn) const {
+  elias_fano::cursor key_cursor(keys);
+  elias_fano::cursor offset_cursor(offsets);
+  uint64_t offset = offsets.size() > 0 ? offset_cursor.next() : 0;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    uint64_t end = offset_cursor.next();
+    fn(key_cursor.next(), offset, end - offset);
+    offset = end;
+  }
+}
+
+void key_directory::write(
+    const std::function<void(const void *, size_t)> &put) const {
+  put(keys.data(), keys.num_words() * sizeof(uint64_t));
+  put(offsets.data(), offsets.num_words() * sizeof(uint64_t));
+}
+
+size_t key_directory::size() const { return keys.size(); }
+
+size_t key_directory::memory_bytes() const {
+  return (keys.num_words() + offsets.num_words()) * sizeof(uint64_t);
+}
+
+snapshot::snapshot() : max_postings(0) {}
+
+// collect live postings from the index, leaving out deleted songs
+void snapshot::from_database(sharded_database &fp_db, database &song_db) {
+  auto tombstones = song_db.get_tombstones();
+
+  songs.clear();
+  song_db.scan_songs([this](const std::array<unsigned char, 16> &id,
+                            const std::string &name) { songs[id] = name; });
+
+  std::vector<std::pair<uint32_t, std::vector<fp_data_t>>> lists;
+  stop_keys.clear();
+  max_postings = 0;
+  for (size_t s = 0; s < fp_db.num_shards(); ++s) {
+    auto &shard = fp_db.shard(s);
+    max_postings = std::max<uint64_t>(max_postings, shard.get_max_postings());
+    auto shard_stop_keys = shard.get_stop_keys();
+    stop_keys.insert(stop_keys.end(), shard_stop_keys.begin(),
+                     shard_stop_keys.end());
+
+    shard.scan_fp([&](uint32_t key, const std::vector<fp_data_t> &value) {
+      std::vector<fp_data_t> live;
+      for (const auto &p : value) {
+        std::array<unsigned char, 16> id;
+        std::copy(p.id, p.id + 16, id.begin());
+        if (tombstones.find(id) == tombstones.end()) {
+          live.push_back(p);
+        }
+      }
+      if (!live.empty()) {
+        lists.emplace_back(key, std::move(live));
+      }
+    });
+  }
+  std::sort(stop_keys.begin(), stop_keys.end());
+
+  // lay postings out in key order
+  std::sort(lists.begin(), lists.end(),
+            [](const std::pair<uint32_t, std::vector<fp_data_t>> &a,
+               const std::pair<uint32_t, std::vector<fp_data_t>> &b) {
+              return a.first < b.first;
+            });
+  keys.clear();
+  postings.clear();
+  for (auto &l : lists) {
+    keys.push_back({l.first, static_cast<uint32_t>(l.second.size()),
+                    postings.size()});
+    postings.insert(postings.end(), l.second.begin(), l.second.end());
+    std::vector<fp_data_t>().swap(l.second);
+  }
+}
+
+// append the list of the next key, keys must be added in increasing order.
+// lists too common for the posting cap become stop keys instead
+void snapshot::add_list(uint32_t key, const fp_data_t *data, size_t size) {
+  if (over_cap(data, size, max_postings)) {
+    stop_keys.push_back(key);
+    return;
+  }
+  keys.push_back({key, static_cast<uint32_t>(size), postings.size()});
+  postings.insert(postings.end(), data, data + size);
+}
+
+void snapshot::to_database(sharded_database &fp_db, database &song_db) const {
+  if (max_postings > 0) {
+    fp_db.set_max_postings(max_postings);
+  }
+  for (uint32_t key : stop_keys) {
+    fp_db.shard(fp_db.shard_of(key)).add_stop_key(key);
+  }
+
+  // hand the lists over in key ordered chunks, so in bucket mode a bucket
+  // is written once per chunk rather than once per key
+  std::vector<std::pair<uint32_t, std::vector<fp_data_t>>> chunk;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    const auto &k = keys[i];
+    chunk.emplace_back(k.key, std::vector<fp_data_t>(
+                                  postings.begin() + k.offset,
+                                  postings.begin() + k.offset + k.size));
+    if (chunk.size() == IMPORT_CHUNK || i + 1 == keys.size()) {
+      fp_db.append_fp_lists(chunk);
+      chunk.clear();
+    }
+  }
+
+  for (const auto &s : songs) {
+    song_db.put_song(s.first, s.second);
+  }
+}
+
+bool snapshot::write(const std::string &path, io_budget *budget) const {
+  std::ofstream f(path, std::ios::binary | std::ios::trunc);
+  if (f.fail()) {
+    return false;
+  }
+
+  // encode the song table
+  std::vector<char> song_bytes;
+  for (const auto &s : songs) {
+    uint32_t len = s.second.length();
+    song_bytes.insert(song_bytes.end(), s.first.begin(), s.first.end());
+    song_bytes.insert(song_bytes.end(), reinterpret_cast<const char *>(&len),
+                      reinterpret_cast<const char *>(&len) + sizeof(len));
+    song_bytes.insert(song_bytes.end(), s.second.begin(), s.second.end());
+  }
+
+  key_directory directory;
+  if (!directory.build(keys.data(), keys.size(), postings.size())) {
+    return false;
+  }
+
+  // compute section offsets
+  snapshot_header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.header_bytes = align8(sizeof(header));
+  header.max_postings = max_postings;
+  header.num_songs = songs.size();
+  header.songs_offset = header.header_bytes;
+  header.num_stop_keys = stop_keys.size();
+  header.stop_keys_offset = align8(header.songs_offset + song_bytes.size());
+  header.num_keys = keys.size();
+  header.keys_offset = align8(header.stop_keys_offset +
+                              stop_keys.size() * sizeof(uint32_t));
+  header.num_postings = postings.size();
+  header.postings_offset = header.keys_offset + directory.memory_bytes();
+  header.file_bytes =
+      align8(header.postings_offset + postings.size() * sizeof(fp_data_t));
+
+  // write sections after a placeholder header, hashing as we go
+  snapshot_hasher hasher;
+  hash_header(header, hasher);
+  size_t pos = header.header_bytes;
+  size_t chunk_bytes = budget ? BUDGET_CHUNK_BYTES : CHUNK_BYTES;
+  auto put = [&f, &hasher, &pos, chunk_bytes, budget](const void *data,
+                                                       size_t n) {
+    for (size_t done = 0; done < n; done += chunk_bytes) {
+      size_t len = std::min(chunk_bytes, n - done);
+      f.write(static_cast<const char *>(data) + done, len);
+      hasher.update(static_cast<const char *>(data) + done, len);
+      if (budget) {
+        budget->spend(len);
+      }
+    }
+    pos += n;
+  };
+  auto pad_to = [&put, &pos](size_t offset) {
+    static const char zeros[8] = {0};
+    put(zeros, offset - pos);
+  };
+
+  std::vector<char> header_pad(header.header_bytes, 0);
+  f.write(header_pad.data(), header_pad.size());
+  put(song_bytes.data(), song_bytes.size());
+  pad_to(header.stop_keys_offset);
+  put(stop_keys.data(), stop_keys.size() * sizeof(uint32_t));
+  pad_to(header.keys_offset);
+  directory.write(put);
+  put(postings.data(), postings.size() * sizeof(fp_data_t));
+  pad_to(header.file_bytes);
+
+  header.checksum = hasher.digest();
+  f.seekp(0);
+  f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  f.close();
+  return !f.fail();
+}
+
+bool snapshot::read(const std::string &path) {
+  std::ifstream f(path, std::ios::binary | std::ios::ate);
+  if (f.fail()) {
+    return false;
+  }
+  uint64_t file_size = f.tellg();
+  f.seekg(0);
+
+  snapshot_header header;
+  f.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (f.fail() || !check_header(header, file_size)) {
+    return false;
+  }
+
+  // read each section in large sequential chunks, hashing as we go
+  snapshot_hasher hasher;
+  hash_header(header, hasher);
+  size_t pos = header.header_bytes;
+  f.seekg(pos);
+  auto get = [&f, &hasher, &pos](void *data, size_t n) {
+    for (size_t done = 0; done < n; done += CHUNK_BYTES) {
+      size_t len = std::min(CHUNK_BYTES, n - done);
+      f.read(static_cast<char *>(data) + done, len);
+      hasher.update(static_cast<char *>(data) + done, len);
+    }
+    pos += n;
+  };
+  auto skip_to = [&get, &pos](size_t offset) {
+    char pad[8];
+    while (pos < offset) {
+      get(pad, std::min(sizeof(pad), offset - pos));
+    }
+  };
+
+  std::vector<char> song_bytes(header.stop_keys_offset - header.songs_offset);
+  get(song_bytes.data(), song_bytes.size());
+  stop_keys.resize(header.num_stop_keys);
+  get(stop_keys.data(), stop_keys.size() * sizeof(uint32_t));
+  skip_to(header.keys_offset);
+  key_directory directory;
+  if (header.version == SNAPSHOT_TABLE_VERSION) {
+    keys.resize(header.num_keys);
+    get(keys.data(), keys.size() * sizeof(snapshot_key));
+  } else {
+    std::vector<uint64_t> words((header.postings_offset - header.keys_offset) /
+                                sizeof(uint64_t));
+    get(words.data(), words.size() * sizeof(uint64_t));
+    if (!directory.read(std::move(words), header.num_postings) ||
+        directory.size() != header.num_keys) {
+      return false;
+    }
+  }
+  skip_to(header.postings_offset);
+  postings.resize(header.num_postings);
+  get(postings.data(), postings.size() * sizeof(fp_data_t));
+  skip_to(header.file_bytes);
+
+  if (f.fail() || hasher.digest() != header.checksum) {
+    return false;
+  }
+
+  if (header.version != SNAPSHOT_TABLE_VERSION) {
+    keys.clear();
+    keys.reserve(header.num_keys);
+    directory.scan([this](uint32_t key, uint64_t offset, uint32_t size) {
+      keys.push_back({key, size, offset});
+    });
+  }
+
+  songs.clear();
+  if (!decode_songs(reinterpret_cast<const uint8_t *>(song_bytes.data()),
+                    song_bytes.size(), header.num_songs, songs)) {
+    return false;
+  }
+
+  max_postings = header.max_postings;
+  return true;
+}
+
+// false unless the header is of a known version and its sections are in
+// order, 8 byte aligned, within file_size bytes and large enough for the
+// counts they hold. readers check this before sizing or reading anything
+bool snapshot::check_header(const snapshot_header &header,
+                            uint64_t file_size) {
+  if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version < SNAPSHOT_TABLE_VERSION ||
+      header.version > SNAPSHOT_VERSION ||
+      header.header_bytes != align8(sizeof(header)) ||
+      header.songs_offset != header.header_bytes ||
+      header.stop_keys_offset < header.songs_offset ||
+      header.keys_offset < header.stop_keys_offset ||
+      header.postings_offset < header.keys_offset ||
+      header.file_bytes < header.postings_offset ||
+      header.file_bytes > file_size) {
+    return false;
+  }
+  for (uint64_t offset : {header.stop_keys_offset, header.keys_offset,
+                          header.postings_offset, header.file_bytes}) {
+    if (offset % 8 != 0) {
+      return false;
+    }
+  }
+
+  // a song takes at least its id and name length
+  uint64_t song_bytes = header.stop_keys_offset - header.songs_offset;
+  uint64_t stop_key_bytes = header.keys_offset - header.stop_keys_offset;
+  uint64_t key_bytes = header.postings_offset - header.keys_offset;
+  uint64_t posting_bytes = header.file_bytes - header.postings_offset;
+  return header.num_songs <= song_bytes / (16 + sizeof(uint32_t)) &&
+         header.num_stop_keys <= stop_key_bytes / sizeof(uint32_t) &&
+         (header.version != SNAPSHOT_TABLE_VERSION ||
+          header.num_keys <= key_bytes / sizeof(snapshot_key)) &&
+         header.num_postings <= posting_bytes / sizeof(fp_data_t);
+}
+
+// start a checksum with the header, with its checksum field zero. older
+// versions leave the header out
+void snapshot::hash_header(const snapshot_header &header,
+                           snapshot_hasher &hasher) {
+  if (header.version < SNAPSHOT_HASHED_HEADER_VERSION) {
+    return;
+  }
+  snapshot_header copy = header;
+  copy.checksum = 0;
+  hasher.update(&copy, sizeof(copy));
+}
+
+// song table entries are {id[16], uint32 name length, name}, false if
+// they run past n_bytes
+bool snapshot::decode_songs(
+    const uint8_t *p, size_t n_bytes, uint64_t num_songs,
+    std::map<std::array<unsigned char, 16>, std::string> &songs) {
+  const uint8_t *end = p + n_bytes;
+  for (uint64_t i = 0; i < num_songs; ++i) {
+    std::array<unsigned char, 16> id;
+    uint32_t len;
+    if (static_cast<size_t>(end - p) < 16 + sizeof(len)) {
+      return false;
+    }
+    std::memcpy(id.data(), p, 16);
+    std::memcpy(&len, p + 16, sizeof(len));
+    p += 16 + sizeof(len);
+    if (static_cast<size_t>(end - p) < len) {
+      return false;
+    }
+    songs[id] = std::string(reinterpret_cast<const char *>(p), len);
+    p += len;
+  }
+  return true;
+}
@@ -0,0 +1,139 @@
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "database.hpp"
+#include "elias_fano.hpp"
+#include "sharded_database.hpp"
+#include "types.hpp"
+
+// on-disk layout of a snapshot, all sections start on 8 byte boundaries:
+//
+//   snapshot_header
+//   songs      num_songs x {id[16], uint32 name length, name}
+//   stop keys  num_stop_keys x uint32
+//   keys       key directory of num_keys keys
+//   postings   num_postings x fp_data_t, grouped by key in key order
+//
+// the checksum covers the header, with the checksum field zero, and every
+// byte after it. version 1 and 2 files leave the header out of it. version
+// 1 files hold the key directory as num_keys x snapshot_key, sorted by
+// key, later versions as the elias-fano words of a key_directory
+
+static constexpr char SNAPSHOT_MAGIC[8] = {'M', 'A', 'S', 'K',
+                                           'S', 'N', 'A', 'P'};
+static constexpr uint32_t SNAPSHOT_VERSION = 3;
+static constexpr uint32_t SNAPSHOT_TABLE_VERSION = 1;
+static constexpr uint32_t SNAPSHOT_HASHED_HEADER_VERSION = 3;
+
+struct snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_bytes;
+  uint64_t max_postings;
+  uint64_t num_songs;
+  uint64_t songs_offset;
+  uint64_t num_stop_keys;
+  uint64_t stop_keys_offset;
+  uint64_t num_keys;
+  uint64_t keys_offset;
+  uint64_t num_postings;
+  uint64_t postings_offset;
+  uint64_t file_bytes;
+  uint64_t checksum;
+};
+
+// directory entry, offset counts postings from the start of the section
+struct snapshot_key {
+  uint32_t key;
+  uint32_t size;
+  uint64_t offset;
+};
+
+// sorted keys and the offsets of their lists as two elias-fano sequences,
+// a few bits per key instead of a snapshot_key. lists are stored back to
+// back in key order, so num_keys + 1 offsets give every list's extent
+class key_directory {
+  public:
+    bool build(const snapshot_key *keys, size_t n, uint64_t num_postings);
+    bool attach(const uint64_t *words, size_t n_words, uint64_t num_postings);
+    bool read(std::vector<uint64_t> &&words, uint64_t num_postings);
+    void clear();
+    bool find(uint32_t key, uint64_t &offset, uint32_t &size) const;
+    void scan(const std::function<void(uint32_t, uint64_t, uint32_t)> &fn)
+        const;
+    void write(const std::function<void(const void *, size_t)> &put) const;
+    size_t size() const;
+    size_t memory_bytes() const;
+
+  private:
+    elias_fano keys;
+    elias_fano offsets;
+    std::vector<uint64_t> storage;
+};
+
+// streaming 64 bit checksum over arbitrarily split input
+class snapshot_hasher {
+  public:
+    snapshot_hasher();
+    void update(const void *data, size_t n);
+    uint64_t digest() const;
+
+  private:
+    void mix(uint64_t word);
+
+    uint64_t h;
+    uint64_t carry;
+    size_t carry_bytes;
+};
+
+// paces sequential I/O to a byte rate, a rate of 0 means unlimited
+class io_budget {
+  public:
+    io_budget(size_t bytes_per_sec = 0);
+    void spend(size_t bytes);
+
+  private:
+    size_t bytes_per_sec;
+    size_t spent;
+    std::chrono::steady_clock::time_point start;
+};
+
+// live contents of the index as a single sequentially readable file
+class snapshot {
+  public:
+    snapshot();
+    void from_database(sharded_database &fp_db, database &song_db);
+    void to_database(sharded_database &fp_db, database &song_db) const;
+    void add_list(uint32_t key, const fp_data_t *data, size_t size);
+    bool write(const std::string &path, io_budget *budget = nullptr) const;
+    bool read(const std::string &path);
+
+    static bool check_header(const snapshot_header &header,
+                             uint64_t file_size);
+    static void hash_header(const snapshot_header &header,
+                            snapshot_hasher &hasher);
+    static bool
+    decode_songs(const uint8_t *p, size_t n_bytes, uint64_t num_songs,
+                 std::map<std::array<unsigned char, 16>, std::string> &songs);
+
+    uint64_t max_postings;
+    std::map<std::array<unsigned char, 16>, std::string> songs;
+    std::vector<uint32_t> stop_keys;
+    std::vector<snapshot_key> keys;
+    std::vector<fp_data_t> postings;
+};
+
+#endif
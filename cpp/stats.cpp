@@ -0,0 +1,264 @@
+#include "stats.hpp"
+
+list_summary::list_summary(size_t top_n) : top_n(top_n) {
+  length_keys.fill(0);
+  length_postings.fill(0);
+  band_keys.fill(0);
+  band_postings.fill(0);
+}
+
+void list_summary::add(uint32_t key, size_t size) {
+  size_t bin = 0;
+  while (bin + 1 < LENGTH_BINS && (size >> (bin + 1)) > 0) {
+    ++bin;
+  }
+  ++length_keys[bin];
+  length_postings[bin] += size;
+  ++band_keys[band_of(key)];
+  band_postings[band_of(key)] += size;
+
+  if (top_n == 0) {
+    return;
+  }
+  if (top.size() < top_n) {
+    top.emplace(size, key);
+  } else if (size > top.top().first) {
+    top.pop();
+    top.emplace(size, key);
+  }
+}
+
+// lists per length range, with the keys and share of postings a stop list
+// cap just below the range would remove
+void list_summary::print_lengths() const {
+  uint64_t total = 0;
+  for (uint64_t p : length_postings) {
+    total += p;
+  }
+
+  std::cout << std::endl
+            << std::setw(23) << "length" << std::setw(12) << "keys"
+            << std::setw(14) << "postings" << std::setw(12) << "keys >="
+            << std::setw(14) << "postings >=" << std::endl;
+  uint64_t keys_above = 0;
+  uint64_t postings_above = 0;
+  std::vector<std::string> lines;
+  for (size_t bin = LENGTH_BINS; bin-- > 0;) {
+    keys_above += length_keys[bin];
+    postings_above += length_postings[bin];
+    if (length_keys[bin] == 0) {
+      continue;
+    }
+    uint64_t low = 1ull << bin;
+    std::ostringstream line;
+    line << std::setw(10) << low << " - " << std::setw(10) << 2 * low - 1
+         << std::setw(12) << length_keys[bin] << std::setw(14)
+         << length_postings[bin] << std::setw(12) << keys_above
+         << std::setw(13) << std::fixed << std::setprecision(2)
+         << (total ? 100.0 * postings_above / total : 0) << "%";
+    lines.push_back(line.str());
+  }
+  for (auto it = lines.rbegin(); it != lines.rend(); ++it) {
+    std::cout << *it << std::endl;
+  }
+}
+
+void list_summary::print_top() {
+  std::vector<std::pair<size_t, uint32_t>> keys;
+  for (; !top.empty(); top.pop()) {
+    keys.push_back(top.top());
+  }
+
+  std::cout << std::endl
+            << std::setw(12) << "key" << std::setw(6) << "band"
+            << std::setw(14) << "postings" << std::endl;
+  for (auto it = keys.rbegin(); it != keys.rend(); ++it) {
+    std::cout << "  0x" << std::hex << std::setw(8) << std::setfill('0')
+              << it->second << std::dec << std::setfill(' ') << std::setw(6)
+              << band_of(it->second) << std::setw(14) << it->first
+              << std::endl;
+  }
+}
+
+void list_summary::print_bands() const {
+  std::cout << std::endl
+            << std::setw(6) << "band" << std::setw(12) << "keys"
+            << std::setw(14) << "postings" << std::setw(10) << "mean"
+            << std::endl;
+  for (uint32_t b = 0; b < MAX_BANDS; ++b) {
+    if (band_keys[b] == 0) {
+      continue;
+    }
+    std::cout << std::setw(6) << b << std::setw(12) << band_keys[b]
+              << std::setw(14) << band_postings[b] << std::setw(10)
+              << std::fixed << std::setprecision(2)
+              << static_cast<double>(band_postings[b]) / band_keys[b]
+              << std::endl;
+  }
+}
+
+void print_usage(const char *name) {
+  std::cout << "Usage: " << name
+            << " [-d] [-t top_n] [-b] [-r] [-s path/to/snapshot]" << std::endl;
+  std::cout << "Print the song and posting counters of the index"
+            << std::endl;
+  std::cout << "  -d  distribution of posting list lengths" << std::endl;
+  std::cout << "  -t  the top_n keys with the longest lists" << std::endl;
+  std::cout << "  -b  keys and postings per band" << std::endl;
+  std::cout << "  -r  recount the counters of an index written before they "
+               "were kept"
+            << std::endl;
+  std::cout << "  -s  read a snapshot instead of fingerprints.db" << std::endl;
+  std::cout << "-d, -t and -b read every posting list" << std::endl;
+}
+
+int print_snapshot(const std::string &path, bool scan, list_summary &summary) {
+  mmap_store snap;
+  if (!snap.open(path)) {
+    std::cerr << "Error: bad snapshot " << path << std::endl;
+    return 1;
+  }
+
+  std::cout << "songs:        " << snap.get_songs().size() << std::endl;
+  std::cout << "fingerprints: " << snap.num_postings() << std::endl;
+  std::cout << "keys:         " << snap.num_keys() << std::endl;
+  std::cout << "bytes:        " << snap.num_postings() * sizeof(fp_data_t)
+            << std::endl;
+  std::cout << "stop keys:    " << snap.get_stop_keys().size() << std::endl;
+  std::cout << "max postings: " << snap.get_max_postings() << std::endl;
+  std::cout << "file bytes:   " << snap.memory_bytes() << std::endl;
+
+  if (scan) {
+    snap.scan([&summary](uint32_t key, posting_list list) {
+      summary.add(key, list.size);
+    });
+  }
+  return 0;
+}
+
+int print_index(bool recount, bool scan, list_summary &summary) {
+  size_t num_shards = sharded_database::count_shards("fingerprints.db");
+  if (num_shards == 0) {
+    std::cerr << "Error: no fingerprints.db" << std::endl;
+    return 1;
+  }
+
+  // only a recount writes
+  std::vector<std::unique_ptr<database>> shards;
+  size_t bytes_on_disk = file_size("songs.db");
+  for (size_t i = 0; i < num_shards; ++i) {
+    std::string path =
+        sharded_database::shard_path("fingerprints.db", i, num_shards);
+    shards.emplace_back(new database(path, 0, !recount));
+    bytes_on_disk += file_size(path);
+  }
+  database song_db("songs.db", 0, !recount);
+  if (recount) {
+    song_db.recount_stats();
+    for (auto &s : shards) {
+      s->recount_stats();
+    }
+  }
+
+  catalogue_stats songs;
+  if (song_db.get_stats(songs)) {
+    std::cout << "songs:        " << songs.songs << std::endl;
+  } else {
+    std::cout << "songs:        not counted" << std::endl;
+  }
+
+  catalogue_stats total = {0, 0, 0, 0};
+  bool counted = true;
+  size_t stop_keys = 0;
+  for (auto &s : shards) {
+    catalogue_stats stats = {0, 0, 0, 0};
+    counted = s->get_stats(stats) && counted;
+    total.keys += stats.keys;
+    total.postings += stats.postings;
+    total.bytes += stats.bytes;
+    stop_keys += s->num_stop_keys();
+  }
+  if (counted) {
+    std::cout << "fingerprints: " << total.postings << std::endl;
+    std::cout << "keys:         " << total.keys << std::endl;
+    std::cout << "bytes:        " << total.bytes << std::endl;
+  } else {
+    std::cout << "fingerprints: not counted" << std::endl;
+  }
+  std::cout << "stop keys:    " << stop_keys << std::endl;
+  std::cout << "max postings: " << shards[0]->get_max_postings() << std::endl;
+  std::cout << "bucket bits:  " << shards[0]->get_bucket_bits() << std::endl;
+  std::cout << "shards:       " << num_shards << std::endl;
+  std::cout << "file bytes:   " << bytes_on_disk << std::endl;
+  if (!counted || !song_db.get_stats(songs)) {
+    std::cerr << "Index written before counters were kept, run with -r"
+              << std::endl;
+  }
+
+  if (scan) {
+    for (auto &s : shards) {
+      s->scan_fp(
+          [&summary](uint32_t key, const std::vector<fp_data_t> &value) {
+            summary.add(key, value.size());
+          },
+          false);
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  // parse options
+  bool lengths = false;
+  bool bands = false;
+  bool recount = false;
+  size_t top_n = 0;
+  std::string snapshot_path;
+  int opt;
+  while ((opt = getopt(argc, argv, "bdrs:t:")) != -1) {
+    switch (opt) {
+    case 'b':
+      bands = true;
+      break;
+    case 'd':
+      lengths = true;
+      break;
+    case 'r':
+      recount = true;
+      break;
+    case 's':
+      snapshot_path = optarg;
+      break;
+    case 't':
+      top_n = std::stoul(optarg);
+      break;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind != argc || (recount && !snapshot_path.empty())) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  list_summary summary(top_n);
+  bool scan = lengths || bands || top_n > 0;
+  int ret = snapshot_path.empty()
+                ? print_index(recount, scan, summary)
+                : print_snapshot(snapshot_path, scan, summary);
+  if (ret != 0) {
+    return ret;
+  }
+
+  if (lengths) {
+    summary.print_lengths();
+  }
+  if (top_n > 0) {
+    summary.print_top();
+  }
+  if (bands) {
+    summary.print_bands();
+  }
+  return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "database.hpp"
+#include "mmap_store.hpp"
+#include "sharded_database.hpp"
+#include "types.hpp"
+
+// posting list lengths are binned by powers of two
+static constexpr size_t LENGTH_BINS = 33;
+
+// what one pass over the posting lists collects for the optional reports
+class list_summary {
+  public:
+    list_summary(size_t top_n);
+    void add(uint32_t key, size_t size);
+    void print_lengths() const;
+    void print_top();
+    void print_bands() const;
+
+  private:
+    std::array<uint64_t, LENGTH_BINS> length_keys;
+    std::array<uint64_t, LENGTH_BINS> length_postings;
+    std::array<uint64_t, MAX_BANDS> band_keys;
+    std::array<uint64_t, MAX_BANDS> band_postings;
+    size_t top_n;
+    // smallest of the longest lists on top
+    std::priority_queue<std::pair<size_t, uint32_t>,
+                        std::vector<std::pair<size_t, uint32_t>>,
+                        std::greater<std::pair<size_t, uint32_t>>>
+        top;
+};
+
+#endif
@@ -0,0 +1,232 @@
+#include "tiered_store.hpp"
+
+// per entry cost of the hash index and shared list beside the postings
+static constexpr size_t ENTRY_OVERHEAD = 96;
+
+tiered_reader::tiered_reader(tiered_store &store,
+                             std::unique_ptr<posting_reader> cold)
+    : store(store), cold(std::move(cold)) {}
+
+posting_list tiered_reader::find(uint32_t key) {
+  uint16_t count = store.touch(key);
+
+  // the reader keeps a hot list alive even if it is demoted meanwhile
+  pinned = store.get_hot(key);
+  if (pinned) {
+    ++store.n_hot;
+    return {pinned->data(), pinned->size()};
+  }
+  if (store.is_absent(key)) {
+    ++store.n_absent;
+    return {nullptr, 0};
+  }
+
+  ++store.n_cold;
+  auto list = cold->find(key);
+  store.promote(key, count, list);
+  return list;
+}
+
+void tiered_reader::find_batch(
+    const uint32_t *keys, size_t n,
+    const std::function<void(size_t, posting_list)> &fn) {
+  cold_keys.clear();
+  cold_slots.clear();
+  cold_counts.clear();
+  for (size_t i = 0; i < n; ++i) {
+    uint16_t count = store.touch(keys[i]);
+    auto hot = store.get_hot(keys[i]);
+    if (hot) {
+      ++store.n_hot;
+      fn(i, {hot->data(), hot->size()});
+    } else if (store.is_absent(keys[i])) {
+      ++store.n_absent;
+      fn(i, {nullptr, 0});
+    } else {
+      cold_keys.push_back(keys[i]);
+      cold_slots.push_back(i);
+      cold_counts.push_back(count);
+    }
+  }
+
+  store.n_cold += cold_keys.size();
+  cold->find_batch(cold_keys.data(), cold_keys.size(),
+                   [this, &fn](size_t j, posting_list list) {
+                     store.promote(cold_keys[j], cold_counts[j], list);
+                     fn(cold_slots[j], list);
+                   });
+}
+
+tiered_store::tiered_store(const std::string filename, size_t ram_bytes)
+    : disk(filename), shard_capacity(ram_bytes / NUM_SHARDS),
+      counters(new std::atomic<uint16_t>[size_t(1) << COUNTER_BITS]),
+      absent(new std::atomic<uint32_t>[size_t(1) << ABSENT_BITS]),
+      n_accesses(0), n_hot(0), n_cold(0), n_absent(0), n_promoted(0),
+      n_demoted(0), hot_bytes(0) {
+  for (size_t i = 0; i < (size_t(1) << COUNTER_BITS); ++i) {
+    counters[i].store(0, std::memory_order_relaxed);
+  }
+  for (size_t i = 0; i < (size_t(1) << ABSENT_BITS); ++i) {
+    absent[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+std::unique_ptr<posting_reader> tiered_store::reader() {
+  return std::unique_ptr<posting_reader>(
+      new tiered_reader(*this, disk.reader()));
+}
+
+size_t tiered_store::num_partitions() const { return disk.num_partitions(); }
+
+size_t tiered_store::partition_of(uint32_t key) const {
+  return disk.partition_of(key);
+}
+
+bool tiered_store::scan_keys(
+    const std::function<void(uint32_t)> &fn) const {
+  return disk.scan_keys(fn);
+}
+
+bool tiered_store::warm_up(const warm_progress &progress) const {
+  return disk.warm_up(progress);
+}
+
+std::string tiered_store::name() const { return "tiered"; }
+
+size_t tiered_store::memory_bytes() const {
+  return (size_t(1) << COUNTER_BITS) * sizeof(uint16_t) +
+         (size_t(1) << ABSENT_BITS) * sizeof(uint32_t) + hot_bytes;
+}
+
+std::string tiered_store::stats() const {
+  uint64_t hot = n_hot + n_absent;
+  uint64_t cold = n_cold;
+  uint64_t total = std::max<uint64_t>(hot + cold, 1);
+  return "ram tier: " + std::to_string(hot) + " hits (" +
+         std::to_string(100 * hot / total) + "%, " +
+         std::to_string(n_absent) + " of absent keys), disk tier: " +
+         std::to_string(cold) + " hits (" + std::to_string(100 * cold / total) +
+         "%), " + std::to_string(n_promoted - n_demoted) + " keys in ram (" +
+         std::to_string(hot_bytes / (1024 * 1024)) + " MiB), " +
+         std::to_string(n_promoted) + " promoted, " +
+         std::to_string(n_demoted) + " demoted";
+}
+
+uint64_t tiered_store::hot_hits() const { return n_hot + n_absent; }
+
+uint64_t tiered_store::cold_hits() const { return n_cold; }
+
+size_t tiered_store::entry_bytes(const std::vector<fp_data_t> &value) {
+  return value.size() * sizeof(fp_data_t) + ENTRY_OVERHEAD;
+}
+
+tiered_store::shard &tiered_store::shard_for(uint32_t key) {
+  return shards[(key * 0x9e3779b1u) >> 28];
+}
+
+// bump the saturating counter of key, returns the new count
+uint16_t tiered_store::touch(uint32_t key) {
+  if ((++n_accesses & ((uint64_t(1) << (COUNTER_BITS + 3)) - 1)) == 0) {
+    age();
+  }
+
+  auto &c = counters[(key * 0x9e3779b97f4a7c15ull) >> (64 - COUNTER_BITS)];
+  uint16_t count = c.load(std::memory_order_relaxed);
+  if (count < UINT16_MAX) {
+    c.store(++count, std::memory_order_relaxed);
+  }
+  return count;
+}
+
+uint16_t tiered_store::count_of(uint32_t key) const {
+  return counters[(key * 0x9e3779b97f4a7c15ull) >> (64 - COUNTER_BITS)].load(
+      std::memory_order_relaxed);
+}
+
+// halve every counter so old popularity decays
+void tiered_store::age() {
+  for (size_t i = 0; i < (size_t(1) << COUNTER_BITS); ++i) {
+    counters[i].store(counters[i].load(std::memory_order_relaxed) / 2,
+                      std::memory_order_relaxed);
+  }
+}
+
+std::atomic<uint32_t> &tiered_store::absent_slot(uint32_t key) {
+  return absent[(key * 0x9e3779b97f4a7c15ull) >> (64 - ABSENT_BITS)];
+}
+
+bool tiered_store::is_absent(uint32_t key) {
+  return absent_slot(key).load(std::memory_order_relaxed) == key + 1;
+}
+
+std::shared_ptr<const std::vector<fp_data_t>>
+tiered_store::get_hot(uint32_t key) {
+  shard &s = shard_for(key);
+  std::lock_guard<std::mutex> lck(s.mtx);
+  auto it = s.index.find(key);
+  if (it == s.index.end()) {
+    return nullptr;
+  }
+  return s.entries[it->second].value;
+}
+
+void tiered_store::promote(uint32_t key, uint16_t count, posting_list list) {
+  if (list.size == 0) {
+    absent_slot(key).store(key + 1, std::memory_order_relaxed);
+    return;
+  }
+  size_t nbytes = list.size * sizeof(fp_data_t) + ENTRY_OVERHEAD;
+  if (nbytes > shard_capacity) {
+    return;
+  }
+
+  shard &s = shard_for(key);
+  std::lock_guard<std::mutex> lck(s.mtx);
+  if (s.index.find(key) != s.index.end()) {
+    return;
+  }
+
+  // free space takes any key, after that demote the coldest of a few
+  // sampled entries while they are colder than the new key
+  while (s.bytes + nbytes > shard_capacity) {
+    size_t victim = 0;
+    uint16_t victim_count = UINT16_MAX;
+    for (size_t i = 0; i < EVICT_SAMPLES; ++i) {
+      s.rng ^= s.rng << 13;
+      s.rng ^= s.rng >> 17;
+      s.rng ^= s.rng << 5;
+      size_t slot = s.rng % s.entries.size();
+      uint16_t c = count_of(s.entries[slot].key);
+      if (c < victim_count) {
+        victim = slot;
+        victim_count = c;
+      }
+    }
+    if (victim_count >= count) {
+      return;
+    }
+    remove(s, victim);
+    ++n_demoted;
+  }
+
+  s.index[key] = s.entries.size();
+  s.entries.push_back(
+      {key, std::make_shared<const std::vector<fp_data_t>>(
+                list.data, list.data + list.size)});
+  s.bytes += nbytes;
+  hot_bytes += nbytes;
+  ++n_promoted;
+}
+
+// move the last entry into the freed slot
+void tiered_store::remove(shard &s, size_t slot) {
+  size_t nbytes = entry_bytes(*s.entries[slot].value);
+  s.bytes -= nbytes;
+  hot_bytes -= nbytes;
+  s.index.erase(s.entries[slot].key);
+  if (slot != s.entries.size() - 1) {
+    s.entries[slot] = std::move(s.entries.back());
+    s.index[s.entries[slot].key] = slot;
+  }
+  s.entries.pop_back();
+}
@@ -0,0 +1,109 @@
+#ifndef _TIERED_STORE_H
+#define _TIERED_STORE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "posting_store.hpp"
+#include "types.hpp"
+#include "unqlite_store.hpp"
+
+class tiered_store;
+
+// looks keys up in the RAM tier first and falls back to a disk reader,
+// the keys of a batch missing from RAM go to disk as one batch
+class tiered_reader : public posting_reader {
+  public:
+    tiered_reader(tiered_store &store, std::unique_ptr<posting_reader> cold);
+    posting_list find(uint32_t key) override;
+    void find_batch(const uint32_t *keys, size_t n,
+                    const std::function<void(size_t, posting_list)> &fn)
+        override;
+
+  private:
+    tiered_store &store;
+    std::unique_ptr<posting_reader> cold;
+    std::shared_ptr<const std::vector<fp_data_t>> pinned;
+    std::vector<uint32_t> cold_keys;
+    std::vector<size_t> cold_slots;
+    std::vector<uint16_t> cold_counts;
+};
+
+// unqlite index with the most frequently probed keys held in RAM. every
+// lookup bumps an approximate access counter for its key. once the RAM
+// budget is used up, a key read from disk is only promoted if its count
+// beats that of a sampled RAM entry, which is demoted to make room.
+// counters are halved periodically so keys that go out of fashion drop
+// back to disk. most probes miss, so keys without postings are not
+// promoted but remembered in a small direct-mapped filter of absent keys,
+// where they cannot push real lists out of RAM
+class tiered_store : public posting_store {
+  public:
+    tiered_store(const std::string filename, size_t ram_bytes);
+    std::unique_ptr<posting_reader> reader() override;
+    size_t num_partitions() const override;
+    size_t partition_of(uint32_t key) const override;
+    bool scan_keys(const std::function<void(uint32_t)> &fn) const override;
+    bool warm_up(const warm_progress &progress) const override;
+    std::string name() const override;
+    size_t memory_bytes() const override;
+    std::string stats() const override;
+    uint64_t hot_hits() const;
+    uint64_t cold_hits() const;
+
+    static constexpr size_t NUM_SHARDS = 16;
+    static constexpr size_t COUNTER_BITS = 20;
+    static constexpr size_t EVICT_SAMPLES = 8;
+    static constexpr size_t ABSENT_BITS = 20;
+
+  private:
+    friend class tiered_reader;
+
+    struct entry {
+      uint32_t key;
+      std::shared_ptr<const std::vector<fp_data_t>> value;
+    };
+
+    struct shard {
+      std::mutex mtx;
+      std::vector<entry> entries;
+      std::unordered_map<uint32_t, size_t> index;
+      size_t bytes = 0;
+      uint32_t rng = 0x9e3779b9;
+    };
+
+    static size_t entry_bytes(const std::vector<fp_data_t> &value);
+    shard &shard_for(uint32_t key);
+    uint16_t touch(uint32_t key);
+    uint16_t count_of(uint32_t key) const;
+    std::atomic<uint32_t> &absent_slot(uint32_t key);
+    bool is_absent(uint32_t key);
+    void age();
+    std::shared_ptr<const std::vector<fp_data_t>> get_hot(uint32_t key);
+    void promote(uint32_t key, uint16_t count, posting_list list);
+    void remove(shard &s, size_t slot);
+
+    unqlite_store disk;
+    std::array<shard, NUM_SHARDS> shards;
+    size_t shard_capacity;
+    std::unique_ptr<std::atomic<uint16_t>[]> counters;
+    // key + 1 of a key known to have no postings, 0 if the slot is free
+    std::unique_ptr<std::atomic<uint32_t>[]> absent;
+    std::atomic<uint64_t> n_accesses;
+    std::atomic<uint64_t> n_hot;
+    std::atomic<uint64_t> n_cold;
+    std::atomic<uint64_t> n_absent;
+    std::atomic<uint64_t> n_promoted;
+    std::atomic<uint64_t> n_demoted;
+    std::atomic<size_t> hot_bytes;
+};
+
+#endif
@@ -1,8 +1,22 @@
 #ifndef _TYPES_H
 #define _TYPES_H
 
+#include <array>
 #include <cstdint>
 
+// fingerprint keys hold the mask bits below the number of their mel band.
+// hamming probes only flip mask bits, so they never leave the band
+static constexpr int MASK_BITS = 22;
+static constexpr uint32_t MAX_BANDS = 32;
+
+inline uint32_t band_of(uint32_t key) {
+  return (key >> MASK_BITS) & (MAX_BANDS - 1);
+}
+
+// how far each mask bit's energy difference was from zero. bits with a
+// small margin are the likeliest to flip under noise
+typedef std::array<float, MASK_BITS> bit_margins;
+
 struct fp_t {
   uint32_t fp;
   int32_t t;
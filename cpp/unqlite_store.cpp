@@ -0,0 +1,159 @@
+#include "unqlite_store.hpp"
+
+unqlite_reader::unqlite_reader(unqlite_store &store,
+                               std::vector<std::unique_ptr<database>> handles)
+    : store(store), handles(std::move(handles)) {}
+
+unqlite_reader::~unqlite_reader() { store.release(std::move(handles)); }
+
+posting_list unqlite_reader::find(uint32_t key) {
+  // serve repeated probes from the shared cache
+  if (store.cache && store.cache->get(key, scratch)) {
+    return {scratch.data(), scratch.size()};
+  }
+
+  scratch = handles[store.partition_of(key)]->get_fp(key);
+  if (store.cache) {
+    store.cache->put(key, scratch);
+  }
+  return {scratch.data(), scratch.size()};
+}
+
+// answer cached keys right away and hand the rest to their shards in one
+// go, which in bucket mode reads a bucket once for all its keys
+void unqlite_reader::find_batch(
+    const uint32_t *keys, size_t n,
+    const std::function<void(size_t, posting_list)> &fn) {
+  shard_keys.resize(handles.size());
+  shard_index.resize(handles.size());
+  for (size_t s = 0; s < handles.size(); ++s) {
+    shard_keys[s].clear();
+    shard_index[s].clear();
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    if (store.cache && store.cache->get(keys[i], scratch)) {
+      fn(i, {scratch.data(), scratch.size()});
+      continue;
+    }
+    size_t s = store.partition_of(keys[i]);
+    shard_keys[s].push_back(keys[i]);
+    shard_index[s].push_back(i);
+  }
+
+  for (size_t s = 0; s < handles.size(); ++s) {
+    handles[s]->get_fp_batch(
+        shard_keys[s].data(), shard_keys[s].size(),
+        [&](size_t j, const std::vector<fp_data_t> &list) {
+          if (store.cache) {
+            store.cache->put(shard_keys[s][j], list);
+          }
+          fn(shard_index[s][j], {list.data(), list.size()});
+        });
+  }
+}
+
+unqlite_store::unqlite_store(const std::string filename, size_t cache_bytes)
+    : filename(filename),
+      num_shards(std::max<size_t>(sharded_database::count_shards(filename), 1)) {
+  // readers may open handles concurrently, and unqlite's lazy library
+  // setup on first open is not safe to race
+  unqlite_lib_init();
+
+  if (cache_bytes > 0) {
+    cache.reset(new posting_cache(cache_bytes));
+  }
+}
+
+std::unique_ptr<posting_reader> unqlite_store::reader() {
+  std::vector<std::unique_ptr<database>> handles;
+
+  // reuse a returned set of handles if there is one
+  {
+    std::lock_guard<std::mutex> lck(pool_mtx);
+    if (!pool.empty()) {
+      handles = std::move(pool.back());
+      pool.pop_back();
+    }
+  }
+
+  // otherwise open every shard read-only. a handle holds unqlite's shared
+  // lock from its first read until it is closed, so no writer can commit
+  // to the shards while this store has readers
+  if (handles.empty()) {
+    for (size_t i = 0; i < num_shards; ++i) {
+      handles.emplace_back(
+          new database(sharded_database::shard_path(filename, i, num_shards),
+                       0, true));
+    }
+  }
+
+  return std::unique_ptr<posting_reader>(
+      new unqlite_reader(*this, std::move(handles)));
+}
+
+size_t unqlite_store::num_partitions() const { return num_shards; }
+
+size_t unqlite_store::partition_of(uint32_t key) const {
+  return sharded_database::shard_of(key, num_shards);
+}
+
+// reads every list once through handles of its own
+bool unqlite_store::scan_keys(
+    const std::function<void(uint32_t)> &fn) const {
+  for (size_t i = 0; i < num_shards; ++i) {
+    database shard(sharded_database::shard_path(filename, i, num_shards), 0,
+                   true);
+    shard.scan_fp(
+        [&fn](uint32_t key, const std::vector<fp_data_t> &) { fn(key); });
+  }
+  return true;
+}
+
+// read every shard file into the page cache in order. unqlite reads its
+// pages with plain reads, which then no longer wait on the disk
+bool unqlite_store::warm_up(const warm_progress &progress) const {
+  std::vector<std::string> paths;
+  uint64_t total = 0;
+  for (size_t i = 0; i < num_shards; ++i) {
+    paths.push_back(sharded_database::shard_path(filename, i, num_shards));
+    struct stat st;
+    if (stat(paths.back().c_str(), &st) == 0) {
+      total += st.st_size;
+    }
+  }
+
+  uint64_t done = 0;
+  for (const auto &path : paths) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      continue;
+    }
+    struct stat st;
+    uint64_t size = fstat(fd, &st) == 0 ? st.st_size : 0;
+    for (uint64_t offset = 0; offset < size;) {
+      uint64_t n = std::min<uint64_t>(WARM_CHUNK, size - offset);
+      readahead(fd, offset, n);
+      offset += n;
+      done = std::min(done + n, total);
+      progress(done, total);
+    }
+    ::close(fd);
+  }
+  return true;
+}
+
+std::string unqlite_store::name() const { return "unqlite"; }
+
+std::string unqlite_store::stats() const {
+  if (!cache) {
+    return "";
+  }
+  return "posting cache: " + std::to_string(cache->hits()) + " hits, " +
+         std::to_string(cache->misses()) + " misses";
+}
+
+void unqlite_store::release(std::vector<std::unique_ptr<database>> handles) {
+  std::lock_guard<std::mutex> lck(pool_mtx);
+  pool.push_back(std::move(handles));
+}
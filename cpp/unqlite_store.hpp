@@ -0,0 +1,70 @@
+#ifndef _UNQLITE_STORE_H
+#define _UNQLITE_STORE_H
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "database.hpp"
+#include "posting_cache.hpp"
+#include "posting_store.hpp"
+#include "sharded_database.hpp"
+#include "types.hpp"
+
+class unqlite_store;
+
+// set of read-only shard handles checked out of an unqlite_store's pool
+class unqlite_reader : public posting_reader {
+  public:
+    unqlite_reader(unqlite_store &store,
+                   std::vector<std::unique_ptr<database>> handles);
+    ~unqlite_reader();
+    posting_list find(uint32_t key) override;
+    void find_batch(const uint32_t *keys, size_t n,
+                    const std::function<void(size_t, posting_list)> &fn)
+        override;
+
+  private:
+    unqlite_store &store;
+    std::vector<std::unique_ptr<database>> handles;
+    std::vector<fp_data_t> scratch;
+    std::vector<std::vector<uint32_t>> shard_keys;
+    std::vector<std::vector<size_t>> shard_index;
+};
+
+// posting store backed by the unqlite shards, one partition per shard.
+// readers take their handles from a pool and share one posting cache, so
+// the lookup path itself takes no store-wide lock. the handles lock the
+// shards against writers while the store is in use, which is what keeps
+// the cache from going stale: ingest fails to commit instead, and has to
+// run while identify is stopped or add a segment with -S
+class unqlite_store : public posting_store {
+  public:
+    unqlite_store(const std::string filename, size_t cache_bytes = 0);
+    std::unique_ptr<posting_reader> reader() override;
+    size_t num_partitions() const override;
+    size_t partition_of(uint32_t key) const override;
+    bool scan_keys(const std::function<void(uint32_t)> &fn) const override;
+    bool warm_up(const warm_progress &progress) const override;
+    std::string name() const override;
+    std::string stats() const override;
+
+  private:
+    friend class unqlite_reader;
+
+    void release(std::vector<std::unique_ptr<database>> handles);
+
+    std::string filename;
+    size_t num_shards;
+    std::unique_ptr<posting_cache> cache;
+    std::mutex pool_mtx;
+    std::vector<std::vector<std::unique_ptr<database>>> pool;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "vote_table.hpp"
+
+vote_table::vote_table(int slack) : slack(slack) { clear(); }
+
+// one vote for the song at offset dt, raising the scores of the windows
+// centred within slack of it
+void vote_table::add(const uint8_t *id, int32_t dt) {
+  for (int32_t centre = dt - slack; centre <= dt + slack; ++centre) {
+    cell &c = find_or_insert(id, centre);
+    ++total;
+    if (++c.score > best.score) {
+      best = c;
+    }
+  }
+}
+
+// add the votes of other, which must have the same slack, and leave it
+// empty but with its capacity kept for the next round of votes
+void vote_table::absorb(vote_table &other) {
+  for (uint32_t i : other.used) {
+    cell &c = other.cells[i];
+    cell &mine = find_or_insert(c.id, c.dt);
+    mine.score += c.score;
+    total += c.score;
+    if (mine.score > best.score) {
+      best = mine;
+    }
+    c.score = 0;
+  }
+  other.used.clear();
+  other.total = 0;
+  std::memset(&other.best, 0, sizeof(other.best));
+}
+
+void vote_table::clear() {
+  cells.assign(MIN_CAPACITY, cell());
+  mask = cells.size() - 1;
+  used.clear();
+  total = 0;
+  std::memset(&best, 0, sizeof(best));
+}
+
+int vote_table::best_score() const { return best.score; }
+
+int32_t vote_table::best_offset() const { return best.dt; }
+
+std::array<uint8_t, 16> vote_table::best_id() const {
+  std::array<uint8_t, 16> id;
+  std::copy(best.id, best.id + 16, id.begin());
+  return id;
+}
+
+// number of song and offset pairs with votes
+size_t vote_table::size() const { return used.size(); }
+
+// sum of the scores of all cells
+uint64_t vote_table::total_score() const { return total; }
+
+// log10 of the number of cells expected to reach the best score by chance.
+// the other cells are taken as a zero-truncated poisson sample of the
+// background of every song and offset, with one more cell of score 2 to
+// stay cautious while there are few votes. their mean score gives the
+// poisson mean lambda, and the number of cells they imply times the
+// chance of one of them reaching the best score is the expected count
+double vote_table::background_log10() const {
+  if (best.score == 0) {
+    return 0;
+  }
+  double n = used.size();
+  double mean = (total - best.score + 2) / n;
+
+  // solve mean = lambda / (1 - exp(-lambda)) by newton's method, the
+  // right hand side grows from 1 at lambda = 0 with slope 1/2
+  double lambda = 2 * (mean - 1);
+  for (int i = 0; i < 50; ++i) {
+    double e = std::exp(-lambda);
+    double f = lambda / (1 - e) - mean;
+    double df = (1 - e - lambda * e) / ((1 - e) * (1 - e));
+    double step = f / df;
+    lambda = std::max(lambda - step, lambda / 2);
+    if (std::abs(step) < 1e-9 * lambda) {
+      break;
+    }
+  }
+  double cells = n / (1 - std::exp(-lambda));
+
+  // poisson tail from the best score up
+  int s = best.score;
+  double term = 1, sum = 1;
+  for (int k = s + 1; k < s + 1000 && term > 1e-12 * sum; ++k) {
+    term *= lambda / k;
+    sum += term;
+  }
+  double log_tail = -lambda + s * std::log(lambda) - std::lgamma(s + 1.0) +
+                    std::log(sum);
+  return std::log10(cells) + log_tail / std::log(10.0);
+}
+
+size_t vote_table::memory_bytes() const {
+  return cells.capacity() * sizeof(cell);
+}
+
+size_t vote_table::slot_of(const uint8_t *id, int32_t dt) const {
+  // song ids are hashes, so their first bytes are already well mixed.
+  // fibonacci hashing spreads neighbouring offsets of a song apart
+  uint64_t h;
+  std::memcpy(&h, id, sizeof(h));
+  h ^= static_cast<uint32_t>(dt);
+  return (h * 0x9e3779b97f4a7c15ull >> 32) & mask;
+}
+
+// cells without a score are free, every stored cell has at least one vote
+vote_table::cell &vote_table::find_or_insert(const uint8_t *id, int32_t dt) {
+  for (size_t i = slot_of(id, dt);; i = (i + 1) & mask) {
+    cell &c = cells[i];
+    if (c.score == 0) {
+      // keep the load at most one half
+      if (2 * (used.size() + 1) > cells.size()) {
+        grow();
+        return find_or_insert(id, dt);
+      }
+      std::memcpy(c.id, id, sizeof(c.id));
+      c.dt = dt;
+      used.push_back(i);
+      return c;
+    }
+    if (c.dt == dt && std::memcmp(c.id, id, sizeof(c.id)) == 0) {
+      return c;
+    }
+  }
+}
+
+void vote_table::grow() {
+  std::vector<cell> old(2 * cells.size(), cell());
+  old.swap(cells);
+  mask = cells.size() - 1;
+  std::vector<uint32_t> old_used;
+  old_used.swap(used);
+  for (uint32_t j : old_used) {
+    const cell &c = old[j];
+    size_t i = slot_of(c.id, c.dt);
+    while (cells[i].score != 0) {
+      i = (i + 1) & mask;
+    }
+    cells[i] = c;
+    used.push_back(i);
+  }
+}
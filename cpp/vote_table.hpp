@@ -0,0 +1,55 @@
+#ifndef _VOTE_TABLE_H
+#define _VOTE_TABLE_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// offset histogram of the songs matched while listening. a vote for a song
+// at time offset dt counts towards every offset within slack of dt, so a
+// score is the number of votes in a window of 2 * slack + 1 offsets. the
+// scores live in one open-addressing table keyed by song and offset, and
+// the best song and offset are kept up to date as votes arrive, so a vote
+// costs 2 * slack + 1 probes instead of a walk down nested trees. tables
+// filled on separate threads add up into one with absorb()
+class vote_table {
+  public:
+    vote_table(int slack = 0);
+    void add(const uint8_t *id, int32_t dt);
+    void absorb(vote_table &other);
+    void clear();
+    int best_score() const;
+    int32_t best_offset() const;
+    std::array<uint8_t, 16> best_id() const;
+    size_t size() const;
+    uint64_t total_score() const;
+    double background_log10() const;
+    size_t memory_bytes() const;
+
+    static constexpr size_t MIN_CAPACITY = 1 << 12;
+
+  private:
+    struct cell {
+      uint8_t id[16];
+      int32_t dt;
+      int32_t score;
+    };
+
+    size_t slot_of(const uint8_t *id, int32_t dt) const;
+    cell &find_or_insert(const uint8_t *id, int32_t dt);
+    void grow();
+
+    int slack;
+    std::vector<cell> cells;
+    size_t mask;
+    // slots holding a cell, so emptying a table costs its cells and not
+    // its capacity
+    std::vector<uint32_t> used;
+    uint64_t total;
+    cell best;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "worker_pool.hpp"
+
+// the calling thread is worker 0, so num_workers - 1 threads are started
+worker_pool::worker_pool(size_t num_workers)
+    : job(nullptr), n_tasks(0), next_task(0), n_running(0), generation(0),
+      stopping(false) {
+  for (size_t w = 1; w < std::max<size_t>(num_workers, 1); ++w) {
+    threads.emplace_back(&worker_pool::work, this, w);
+  }
+}
+
+worker_pool::~worker_pool() {
+  {
+    std::lock_guard<std::mutex> lck(mtx);
+    stopping = true;
+  }
+  start_cv.notify_all();
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+// call fn(worker, task) for every task below num_tasks
+void worker_pool::run(size_t num_tasks,
+                      const std::function<void(size_t, size_t)> &fn) {
+  if (num_tasks == 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lck(mtx);
+    job = &fn;
+    n_tasks = num_tasks;
+    next_task = 0;
+    n_running = threads.size();
+    ++generation;
+  }
+  start_cv.notify_all();
+  drain(0);
+
+  std::unique_lock<std::mutex> lck(mtx);
+  done_cv.wait(lck, [this]() { return n_running == 0; });
+  job = nullptr;
+}
+
+size_t worker_pool::size() const { return threads.size() + 1; }
+
+void worker_pool::work(size_t worker) {
+  uint64_t seen = 0;
+  while (true) {
+    std::unique_lock<std::mutex> lck(mtx);
+    start_cv.wait(lck, [this, seen]() {
+      return stopping || generation != seen;
+    });
+    if (stopping) {
+      return;
+    }
+    seen = generation;
+    lck.unlock();
+
+    drain(worker);
+
+    lck.lock();
+    if (--n_running == 0) {
+      done_cv.notify_all();
+    }
+  }
+}
+
+void worker_pool::drain(size_t worker) {
+  for (size_t task = next_task++; task < n_tasks; task = next_task++) {
+    (*job)(worker, task);
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef _WORKER_POOL_H
+#define _WORKER_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// threads kept for the whole run, working through one parallel loop at a
+// time. run() hands the tasks out to the threads and to the calling one,
+// each taking the next task as it finishes the last, and returns once all
+// of them are done. fn gets the number of the worker running the task, so
+// workers can keep state of their own between tasks and loops
+class worker_pool {
+  public:
+    worker_pool(size_t num_workers);
+    ~worker_pool();
+    worker_pool(const worker_pool &) = delete;
+    worker_pool &operator=(const worker_pool &) = delete;
+    void run(size_t num_tasks,
+             const std::function<void(size_t, size_t)> &fn);
+    size_t size() const;
+
+  private:
+    void work(size_t worker);
+    void drain(size_t worker);
+
+    std::vector<std::thread> threads;
+    std::mutex mtx;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+    const std::function<void(size_t, size_t)> *job;
+    size_t n_tasks;
+    std::atomic<size_t> next_task;
+    size_t n_running;
+    uint64_t generation;
+    bool stopping;
+};
+
+#endif